@@ -1,115 +1,296 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/face.hpp>
 
-class PointState {
+// Constant velocity Kalman filters for many points (eg. the landmarks of
+// several faces), the same model as one cv::KalmanFilter(4, 2) per point
+// measuring x and y. With H = [I 0] and a process noise that does not mix
+// x and y, the 4x4 covariance of a point stays two independent 2x2 blocks,
+// so each axis of each point is a 2 state filter with a closed-form update.
+// The states and covariances are kept in contiguous arrays indexed by
+// 2 * point + axis, so one loop over them updates every filter. The arrays
+// are passed as __restrict pointers so the compiler may vectorize the loops
+// (gcc -O3 -fopt-info-vec reports both as vectorized).
+class KalmanBank {
 public:
-    PointState(cv::Point2f point): m_point(point), m_kalman(4, 2, 0, CV_64F) {
-        init();
+    KalmanBank(double deltaTime = 0.9, double accelNoiseMag = 0.1,
+               double measurementNoise = 0.1, double initialError = 0.1)
+        : m_deltaTime(deltaTime), m_measurementNoise(measurementNoise),
+          m_initialError(initialError) {
+        m_q00 = pow(deltaTime, 4.0) / 4.0 * accelNoiseMag;
+        m_q01 = pow(deltaTime, 3.0) / 2.0 * accelNoiseMag;
+        m_q11 = pow(deltaTime, 2.0) * accelNoiseMag;
     }
-    
-    void update(cv::Point2f point) {
-        cv::Mat measurement(2, 1, CV_64FC1);
-        if (point.x < 0 || point.y < 0) {
-            predict();
-            measurement.at<double>(0) = m_point.x; // update using prediction
-            measurement.at<double>(1) = m_point.y;
-            m_isPredicted = true;
-        } else {
-            measurement.at<double>(0) = point.x; // update using measurements
-            measurement.at<double>(1) = point.y;
-            m_isPredicted = false;
+
+    // Starts filters at points, at rest. Returns the index of the first one.
+    int add(const std::vector<cv::Point2f>& points) {
+        int first = size();
+        for (const cv::Point2f& p : points) {
+            for (double v : {(double)p.x, (double)p.y}) {
+                m_pos.push_back(v);
+                m_vel.push_back(0);
+                m_p00.push_back(m_initialError);
+                m_p01.push_back(0);
+                m_p11.push_back(m_initialError);
+                m_z.push_back(0);
+            }
+            m_predicted.push_back(false);
         }
+        return first;
+    }
 
-        // correction 
-        cv::Mat estimated = m_kalman.correct(measurement);
-        m_point.x = static_cast<float>(estimated.at<double>(0));
-        m_point.y = static_cast<float>(estimated.at<double>(1));
+    // Restarts points [first, first + points.size()) at points, at rest.
+    void reset(int first, const std::vector<cv::Point2f>& points) {
+        CV_Assert(first >= 0 && first + (int)points.size() <= size());
+        for (size_t i = 0; i < points.size(); i++) {
+            const int j = 2 * (first + (int)i);
+            m_pos[j] = points[i].x;
+            m_pos[j + 1] = points[i].y;
+            for (int k = j; k < j + 2; k++) {
+                m_vel[k] = 0;
+                m_p00[k] = m_initialError;
+                m_p01[k] = 0;
+                m_p11[k] = m_initialError;
+            }
+            m_predicted[first + i] = false;
+        }
+    }
 
-        predict();
+    void clear() {
+        m_pos.clear();
+        m_vel.clear();
+        m_p00.clear();
+        m_p01.clear();
+        m_p11.clear();
+        m_z.clear();
+        m_predicted.clear();
     }
 
-    cv::Point2f getPoint() const {
-        return m_point;
+    int size() const {
+        return (int)m_predicted.size();
     }
 
-    bool isPredicted() const {
-        return m_isPredicted;
+    // Corrects points [first, first + measurements.size()) with the measurements
+    // and predicts their next position. A point with a negative coordinate was
+    // not measured and is corrected with its own prediction instead.
+    void update(int first, const std::vector<cv::Point2f>& measurements) {
+        const int begin = 2 * first;
+        const int end = 2 * (first + (int)measurements.size());
+        CV_Assert(first >= 0 && end <= (int)m_pos.size());
+        for (size_t i = 0; i < measurements.size(); i++) {
+            const cv::Point2f& p = measurements[i];
+            const int j = begin + 2 * (int)i;
+            m_predicted[first + i] = p.x < 0 || p.y < 0;
+            if (m_predicted[first + i]) {
+                predict(j, j + 2);
+                m_z[j] = m_pos[j];
+                m_z[j + 1] = m_pos[j + 1];
+            } else {
+                m_z[j] = p.x;
+                m_z[j + 1] = p.y;
+            }
+        }
+        correct(begin, end);
+        predict(begin, end);
+    }
+
+    cv::Point2f getPoint(int i) const {
+        return cv::Point2f(static_cast<float>(m_pos[2 * i]), static_cast<float>(m_pos[2 * i + 1]));
+    }
+
+    bool isPredicted(int i) const {
+        return m_predicted[i];
     }
 
 private:
+    double m_deltaTime;
+    double m_measurementNoise;
+    double m_initialError;
+    double m_q00, m_q01, m_q11;   // process noise of one axis
 
-    cv::Point2f m_point;
-    cv::KalmanFilter m_kalman;
-    
-    double m_deltaTime = 0.9;
-    double m_accelNoiseMag = 0.1;
-    
-    bool m_isPredicted = false;
-
-    void init() {
-        m_kalman.transitionMatrix = (cv::Mat_<double>(4,4) << 
-                1, 0, m_deltaTime, 0,
-                0, 1, 0, m_deltaTime, 
-                0, 0, 1, 0,
-                0, 0, 0, 1);
-        // init position x, y
-        m_kalman.statePre.at<double>(0) = m_point.x;
-        m_kalman.statePre.at<double>(1) = m_point.y;
-        // init velocity x, y
-        m_kalman.statePre.at<double>(2) = 1;
-        m_kalman.statePre.at<double>(3) = 1;
-        
-        m_kalman.statePost.at<double>(0) = m_point.x;
-        m_kalman.statePost.at<double>(1) = m_point.y;
-        
-        cv::setIdentity(m_kalman.measurementMatrix);
-        
-        m_kalman.processNoiseCov = (cv::Mat_<double>(4, 4) << 
-                pow(m_deltaTime, 4.0) / 4.0, 0, pow(m_deltaTime, 3.0) / 2.0, 0,
-                0, pow(m_deltaTime, 4.0) / 4.0, 0, pow(m_deltaTime, 3.0) / 2.0,
-                pow(m_deltaTime, 3.0) / 2.0, 0, pow(m_deltaTime, 2.0), 0,
-                0, pow(m_deltaTime, 3.0) / 2.0, 0, pow(m_deltaTime, 2.0));
-
-
-        m_kalman.processNoiseCov *= m_accelNoiseMag;
-        cv::setIdentity(m_kalman.measurementNoiseCov, cv::Scalar::all(0.1));
-        cv::setIdentity(m_kalman.errorCovPost, cv::Scalar::all(.1));
-    }
-
-    cv::Point2f predict() {
-        cv::Mat prediction = m_kalman.predict();
-        m_point.x = static_cast<float>(prediction.at<double>(0));
-        m_point.y = static_cast<float>(prediction.at<double>(1));
-        return m_point;
-    }
-}; // class PointState
-
-void track(cv::Mat prevFrame, cv::Mat currFrame, const std::vector<cv::Point2f>& currLandmarks, 
-        std::vector<PointState>& trackPoints) {
-    
-    // cv::resize(prevFrame, prevFrame, cv::Size(scale, scale));
-    // cv::resize(currFrame, currFrame, cv::Size(scale, scale));
-    
-    cv::TermCriteria termcrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01);
-    cv::Size winSize(7, 7);
-    std::vector<uchar> status(trackPoints.size(), 0);
-    std::vector<float> err;
-    std::vector<cv::Point2f> newLandmarks;
+    // per axis of each point: position, velocity, covariance [p00 p01; p01 p11]
+    std::vector<double> m_pos;
+    std::vector<double> m_vel;
+    std::vector<double> m_p00;
+    std::vector<double> m_p01;
+    std::vector<double> m_p11;
+    std::vector<double> m_z;       // measurements of the current update
+    std::vector<bool> m_predicted;
+
+    void predict(int begin, int end) {
+        predictAxes(begin, end, m_deltaTime, m_q00, m_q01, m_q11,
+                m_pos.data(), m_vel.data(), m_p00.data(), m_p01.data(), m_p11.data());
+    }
+
+    void correct(int begin, int end) {
+        correctAxes(begin, end, m_measurementNoise, m_z.data(),
+                m_pos.data(), m_vel.data(), m_p00.data(), m_p01.data(), m_p11.data());
+    }
+
+    // x = F x, P = F P F' + Q with F = [1 dt; 0 1]
+    static void predictAxes(int begin, int end, double dt, double q00, double q01, double q11,
+            double* __restrict pos, const double* __restrict vel,
+            double* __restrict p00, double* __restrict p01, double* __restrict p11) {
+        for (int j = begin; j < end; j++) {
+            pos[j] += dt * vel[j];
+            p00[j] += 2 * dt * p01[j] + dt * dt * p11[j] + q00;
+            p01[j] += dt * p11[j] + q01;
+            p11[j] += q11;
+        }
+    }
+
+    // K = P H' / (H P H' + r), x += K (z - H x), P -= K H P with H = [1 0]
+    static void correctAxes(int begin, int end, double r, const double* __restrict z,
+            double* __restrict pos, double* __restrict vel,
+            double* __restrict p00, double* __restrict p01, double* __restrict p11) {
+        for (int j = begin; j < end; j++) {
+            const double s = 1.0 / (p00[j] + r);
+            const double k0 = p00[j] * s;
+            const double k1 = p01[j] * s;
+            const double y = z[j] - pos[j];
+            pos[j] += k0 * y;
+            vel[j] += k1 * y;
+            p11[j] -= k1 * p01[j];
+            p01[j] -= k0 * p01[j];
+            p00[j] -= k0 * p00[j];
+        }
+    }
+}; // class KalmanBank
+
+// Optical flow front end of the stabilizer. Each frame's pyramid is built
+// once, when the frame arrives, and kept as the previous pyramid for the
+// next frame instead of calcOpticalFlowPyrLK rebuilding both every call.
+// With scale < 1 the flow is computed on a downscaled gray frame, while
+// the points stay in full resolution coordinates.
+class PyramidFlow {
+public:
+    PyramidFlow(double scale = 1.0, cv::Size winSize = cv::Size(7, 7), int maxLevel = 3)
+        : m_scale(scale), m_winSize(winSize), m_maxLevel(maxLevel), m_hasPrevious(false) {}
+
+    void setFrame(const cv::Mat& gray) {
+        std::swap(m_prevPyramid, m_currPyramid);
+        m_hasPrevious = !m_prevPyramid.empty();
+        const cv::Mat* image = &gray;
+        if (m_scale != 1.0) {
+            cv::resize(gray, m_small, cv::Size(), m_scale, m_scale, cv::INTER_AREA);
+            image = &m_small;
+        }
+        // the buffers of the pyramid two frames back are reused
+        cv::buildOpticalFlowPyramid(*image, m_currPyramid, m_winSize, m_maxLevel);
+    }
+
+    bool hasPrevious() const {
+        return m_hasPrevious;
+    }
+
+    // tracks all points from the previous frame to the current one in one call
+    void track(const std::vector<cv::Point2f>& prevPoints, std::vector<cv::Point2f>& currPoints,
+            std::vector<uchar>& status) {
+        cv::TermCriteria termcrit(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 30, 0.01);
+        m_prevScaled.resize(prevPoints.size());
+        for (size_t i = 0; i < prevPoints.size(); i++) {
+            m_prevScaled[i] = prevPoints[i] * m_scale;
+        }
+        cv::calcOpticalFlowPyrLK(m_prevPyramid, m_currPyramid, m_prevScaled, currPoints,
+                status, m_err, m_winSize, m_maxLevel, termcrit, 0, 0.001);
+        for (size_t i = 0; i < currPoints.size(); i++) {
+            currPoints[i] *= 1.0 / m_scale;
+        }
+    }
+
+private:
+    double m_scale;
+    cv::Size m_winSize;
+    int m_maxLevel;
+    bool m_hasPrevious;
+    cv::Mat m_small;
+    std::vector<cv::Mat> m_prevPyramid;
+    std::vector<cv::Mat> m_currPyramid;
+    std::vector<cv::Point2f> m_prevScaled;
+    std::vector<float> m_err;
+}; // class PyramidFlow
+
+// The filters of one face: points [first, first + count) of the bank, and the
+// landmark box of the face when it was last seen.
+struct FaceSlot {
+    int first;
+    int count;
+    cv::Rect box;
+    bool active;
+};
+
+static float overlap(const cv::Rect& a, const cv::Rect& b) {
+    float inter = (a & b).area();
+    float uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0f;
+}
+
+// Gives every face the active slot its landmark box overlaps most, if that is
+// at least minOverlap and the slot is not taken yet, or -1 for a new face.
+static std::vector<int> matchFaces(const std::vector<std::vector<cv::Point2f> >& landmarks,
+        const std::vector<FaceSlot>& slots, float minOverlap = 0.2f) {
+    std::vector<int> slotOf(landmarks.size(), -1);
+    std::vector<bool> taken(slots.size(), false);
+    for (size_t f = 0; f < landmarks.size(); f++) {
+        const cv::Rect box = cv::boundingRect(landmarks[f]);
+        float best = minOverlap;
+        for (size_t s = 0; s < slots.size(); s++) {
+            if (!slots[s].active || taken[s] || slots[s].count != (int)landmarks[f].size())
+                continue;
+            float o = overlap(slots[s].box, box);
+            if (o > best) {
+                best = o;
+                slotOf[f] = (int)s;
+            }
+        }
+        if (slotOf[f] >= 0)
+            taken[slotOf[f]] = true;
+    }
+    return slotOf;
+}
+
+// Tracks the points of the matched faces' slots into the current frame, all in
+// one flow call, and corrects them with the average of the flow and the new
+// landmarks. Faces without a slot (slotOf -1) are skipped.
+void track(PyramidFlow& flow, const std::vector<std::vector<cv::Point2f> >& landmarks,
+        const std::vector<int>& slotOf, const std::vector<FaceSlot>& slots, KalmanBank& trackPoints) {
     std::vector<cv::Point2f> prevLandmarks;
-    std::for_each(trackPoints.begin(), trackPoints.end(), 
-            [&](const PointState& pts) { prevLandmarks.push_back(pts.getPoint());});
-    cv::calcOpticalFlowPyrLK(prevFrame, currFrame, prevLandmarks, newLandmarks, 
-            status, err, winSize, 3, termcrit, 0, 0.001);
-    for (size_t i = 0; i < status.size(); i++) {
-        if (status[i]) {
-            trackPoints[i].update((newLandmarks[i] + currLandmarks[i])/2);
-        } else {
-            trackPoints[i].update(currLandmarks[i]);
+    for (size_t f = 0; f < landmarks.size(); f++) {
+        if (slotOf[f] < 0)
+            continue;
+        const FaceSlot& slot = slots[slotOf[f]];
+        for (int i = 0; i < slot.count; i++) {
+            prevLandmarks.push_back(trackPoints.getPoint(slot.first + i));
         }
     }
+    if (prevLandmarks.empty())
+        return;
+    std::vector<uchar> status;
+    std::vector<cv::Point2f> newLandmarks;
+    flow.track(prevLandmarks, newLandmarks, status);
+    size_t k = 0;
+    for (size_t f = 0; f < landmarks.size(); f++) {
+        if (slotOf[f] < 0)
+            continue;
+        const std::vector<cv::Point2f>& currLandmarks = landmarks[f];
+        std::vector<cv::Point2f> measurements(currLandmarks.size());
+        for (size_t i = 0; i < currLandmarks.size(); i++, k++) {
+            if (status[k]) {
+                measurements[i] = (newLandmarks[k] + currLandmarks[i])/2;
+            } else {
+                measurements[i] = currLandmarks[i];
+            }
+        }
+        trackPoints.update(slots[slotOf[f]].first, measurements);
+    }
 }
 
 int main(int argc, char** argv) {
+    // optional: fraction of the frame size the optical flow runs at, eg. 0.5
+    const double flowScale = argc > 1 ? atof(argv[1]) : 1.0;
+    if (flowScale <= 0 || flowScale > 1) {
+        std::cerr << "usage: " << argv[0] << " [flow scale in (0, 1]]" << std::endl;
+        return 1;
+    }
     cv::CascadeClassifier faceDetector("resources/haarcascade_frontalface_alt2.xml");
     cv::Ptr<cv::face::Facemark> facemark = cv::face::FacemarkLBF::create();
     facemark->loadModel("resources/lbfmodel.yaml");
@@ -117,74 +298,82 @@ int main(int argc, char** argv) {
     cv::namedWindow("Facial Landmark Localization and Stabilization", cv::WINDOW_NORMAL);
     cv::Mat frame;
     cv::Mat currGray;
-    cv::Mat prevGray;
-    std::vector<PointState> trackPoints;
-    trackPoints.reserve(68);
+    PyramidFlow flow(flowScale);
+    // one filter per landmark of every face, each face owns the range of one
+    // slot; slots of faces that left are reused by new ones
+    KalmanBank trackPoints;
+    std::vector<FaceSlot> slots;
+    std::vector<cv::Point2f> allLandmarks;
     
-    const int scale  = 1;
     while(cap.read(frame)) {
         std::vector<cv::Rect> faces;
         cv::cvtColor(frame, currGray, cv::COLOR_BGR2GRAY);        
-        faceDetector.detectMultiScale(currGray, faces, 1.1, 3, cv::CASCADE_FIND_BIGGEST_OBJECT);
+        flow.setFrame(currGray);
+        faceDetector.detectMultiScale(currGray, faces, 1.1, 3);
         std::vector<std::vector<cv::Point2f> > landmarks;
-        bool success = facemark->fit(frame, faces, landmarks);
+        bool success = !faces.empty() && facemark->fit(frame, faces, landmarks);
 
         if (success) {
-            if (prevGray.empty()) {
-                trackPoints.clear();
-                for (cv::Point2f lp: landmarks[0]) {
-                    cv::Point2f pt = cv::Point2f(lp.x/scale, lp.y/scale);
-                    trackPoints.emplace_back(pt);
-                } 
-            } else {
-                if (trackPoints.empty()) {
-                    for (cv::Point2f lp: landmarks[0]) {
-                        cv::Point2f pt = cv::Point2f(lp.x/scale, lp.y/scale);
-                        trackPoints.emplace_back(pt);
-                    }
+            // faces follow their filters by the overlap of their landmark boxes,
+            // so crossing faces or one face replacing another keep apart
+            std::vector<int> slotOf(landmarks.size(), -1);
+            if (flow.hasPrevious()) {
+                slotOf = matchFaces(landmarks, slots);
+            }
+            track(flow, landmarks, slotOf, slots, trackPoints);
+
+            std::vector<bool> seen(slots.size(), false);
+            for (size_t f = 0; f < landmarks.size(); f++) {
+                if (slotOf[f] >= 0)
+                    seen[slotOf[f]] = true;
+            }
+            // the filters of faces that are gone are freed, not carried over
+            for (size_t s = 0; s < slots.size(); s++) {
+                if (!seen[s])
+                    slots[s].active = false;
+            }
+            // new faces start at rest in a free slot or at the end of the bank
+            for (size_t f = 0; f < landmarks.size(); f++) {
+                if (slotOf[f] >= 0)
+                    continue;
+                const int count = (int)landmarks[f].size();
+                for (size_t s = 0; s < slots.size() && slotOf[f] < 0; s++) {
+                    if (!slots[s].active && slots[s].count == count)
+                        slotOf[f] = (int)s;
+                }
+                if (slotOf[f] < 0) {
+                    FaceSlot slot = {trackPoints.add(landmarks[f]), count, cv::Rect(), false};
+                    slots.push_back(slot);
+                    slotOf[f] = (int)slots.size() - 1;
                 } else {
-                    cv::resize(prevGray, prevGray, cv::Size(scale, scale));
-                    cv::resize(currGray, currGray, cv::Size(scale, scale));
-                    for (size_t i = 0; i < landmarks[0].size(); i++) {
-                        
-                        cv::Point2f pt = landmarks[0][i];
-                        pt.x /= scale;
-                        pt.y /= scale;
-                        landmarks[0][i] = pt;
-                    }
-                    track(prevGray, currGray, landmarks[0], trackPoints);
-                    for (size_t i = 0; i < landmarks[0].size(); i++) {
-                        
-                        cv::Point2f pt = landmarks[0][i];
-                        pt.x *= scale;
-                        pt.y *= scale;
-                        landmarks[0][i] = pt;
-                    }
-                    
-                    // trackPoints.clear();
-                    // for (cv::Point2f lp: landmarks[0]) {
-                    //    trackPoints.emplace_back(lp);
-                    // }
-            
+                    trackPoints.reset(slots[slotOf[f]].first, landmarks[f]);
                 }
             }
-            
-            for (const PointState& tp: trackPoints) {
-                std::cout << trackPoints.size() << std::endl; 
-                cv::Point2f pt = tp.getPoint();
-                pt.x *= scale;
-                pt.y *= scale;
-                cv::circle(frame, pt, 3, tp.isPredicted() ? cv::Scalar(0, 0, 255) : cv::Scalar(0, 255, 0), cv::FILLED);
+            for (size_t f = 0; f < landmarks.size(); f++) {
+                FaceSlot& slot = slots[slotOf[f]];
+                slot.box = cv::boundingRect(landmarks[f]);
+                slot.active = true;
+            }
+
+            allLandmarks.clear();
+            for (const std::vector<cv::Point2f>& face : landmarks) {
+                allLandmarks.insert(allLandmarks.end(), face.begin(), face.end());
+            }
+            for (const FaceSlot& slot : slots) {
+                if (!slot.active)
+                    continue;
+                for (int i = slot.first; i < slot.first + slot.count; i++) {
+                    cv::circle(frame, trackPoints.getPoint(i), 3, trackPoints.isPredicted(i) ? cv::Scalar(0, 0, 255) : cv::Scalar(0, 255, 0), cv::FILLED);
+                }
             }
 
-            for (cv::Point2f lp: landmarks[0]) {
+            for (cv::Point2f lp: allLandmarks) {
                 cv::circle(frame, lp, 2, cv::Scalar(255, 0, 255), cv::FILLED);
             }
         }
         cv::imshow("Facial Landmark Localization and Stabilization", frame);
         if (cv::waitKey(1) == 27)
             break;
-        prevGray = currGray;
     }
 
     return 0;
@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "detect_regions.hpp"
+#include "ocr.hpp"
+#include "percentile.hpp"
+#include "plate_verifier.hpp"
+#include "svm_dataset.hpp"
+
+#include <opencv2/opencv.hpp>
+
+// Golden set benchmark: runs detect + verify + OCR over the labeled stills
+// in test/ (file name is the plate number), the classifier over the
+// labeled character crops and the verifier over the plate/noPlate crops.
+// The tiled region search is compared with the whole image search on the
+// same stills. Classifier and verifier are trained on all but every
+// holdout-th crop and scored on the rest; the dnn graph is scored on its
+// own DNN_data/test set. Exits with 1 when a result falls more than the
+// tolerance below the measurement stored with --write_baseline.
+
+static std::string baseName(const std::string &path)
+{
+    size_t i = path.find_last_of('/');
+    std::string fn = (i == std::string::npos) ? path : path.substr(i+1);
+    return fn.substr(0, fn.find_last_of('.'));
+}
+
+static double elapsedMs(int64 start)
+{
+    return (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency();
+}
+
+static void printLatency(const std::string &stage, const std::vector<double> &ms)
+{
+    std::cout << "  " << stage << ": p50 " << percentile(ms, 50) << " ms, p95 " <<
+                 percentile(ms, 95) << " ms, p99 " << percentile(ms, 99) <<
+                 " ms" << std::endl;
+}
+
+// value has to reach the stored measurement minus tolerance, which is an
+// absolute amount for accuracies and a fraction of the measurement for
+// throughput; a result without a stored measurement is only reported
+static bool check(const cv::FileStorage &fs, const std::string &key, const std::string &name,
+                  double value, double tolerance, bool relative = false)
+{
+    cv::FileNode node = fs[key];
+    if (!node.isReal() && !node.isInt()) {
+        std::cout << "  " << name << ": " << value << " (no baseline, run with "
+                     "--write_baseline)" << std::endl;
+        return true;
+    }
+    double baseline = (double)node;
+    double minimum = relative ? baseline * (1.0 - tolerance) : baseline - tolerance;
+    bool ok = value >= minimum;
+    std::cout << "  " << name << ": " << value << " (baseline " << baseline <<
+                 ", minimum " << minimum << ") " << (ok ? "ok" : "FAILED") << std::endl;
+    return ok;
+}
+
+// reads the grayscale images of dir matching pattern, sorted by name
+static std::vector<cv::Mat> readCrops(const std::string &dir, const std::string &pattern)
+{
+    std::vector<cv::String> files;
+    cv::glob(dir + "/" + pattern, files);
+    std::vector<cv::Mat> crops;
+    for (size_t i = 0; i < files.size(); i++) {
+        cv::Mat img = cv::imread(files[i], 0);
+        if (!img.empty()) {
+            crops.push_back(img);
+        }
+    }
+    return crops;
+}
+
+int main(int argc, char **argv)
+{
+    cv::CommandLineParser parser(
+        argc, argv,
+        "{help h usage?  |                        | print this message}"
+        "{test t         | test                   | directory of labeled stills}"
+        "{data d         | data/chars_seg         | directory with chars/, plate/ and noPlate/}"
+        "{ocr o          | OCR.xml                | OCR training data}"
+        "{method m       | mlp                    | character classifier: mlp, knn or dnn}"
+        "{dnn_model      | data/model.pb          | tensorflow graph for --method dnn}"
+        "{tile_height    | 200                    | stripe height of the tiled search compared with the whole image search}"
+        "{holdout        | 5                      | every n-th crop is held out to score the classifier and verifier}"
+        "{baseline b     | benchmark_baseline.yml | measured throughput and accuracy to compare with}"
+        "{write_baseline | false                  | store the measured results as the new baseline}"
+    );
+    if (parser.has("help")) {
+        parser.printMessage();
+        return 0;
+    }
+    std::string test_dir = parser.get<std::string>("test");
+    std::string data_dir = parser.get<std::string>("data");
+    std::string method = parser.get<std::string>("method");
+    std::string baseline_file = parser.get<std::string>("baseline");
+    int holdout = std::max(2, parser.get<int>("holdout"));
+
+    SvmDataset svm_dataset;
+    cv::Mat svm_training_data;
+    cv::Mat svm_training_label;
+    if (svm_dataset.open("svm.bin")) {
+        svm_training_data = svm_dataset.data;
+        svm_training_label = svm_dataset.labels;
+    } else {
+        cv::FileStorage fs;
+        fs.open("svm.xml", cv::FileStorage::READ);
+        fs["training_data"] >> svm_training_data;
+        fs["training_labels"] >> svm_training_label;
+    }
+    PlateVerifier verifier;
+    verifier.train(svm_training_data, svm_training_label);
+
+    int ocr_method = (method == "knn") ? OCR_KNN : (method == "dnn") ? OCR_DNN : OCR_MLP;
+    OCR ocr(parser.get<std::string>("ocr"), ocr_method, parser.get<std::string>("dnn_model"));
+    DetectRegions detectRegions;
+
+    // full pipeline over the stills
+    // the stills come with either extension; on case insensitive file
+    // systems both patterns match the same files
+    std::vector<cv::String> files;
+    std::vector<cv::String> lower_files;
+    cv::glob(test_dir + "/*.JPG", files);
+    cv::glob(test_dir + "/*.jpg", lower_files);
+    files.insert(files.end(), lower_files.begin(), lower_files.end());
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    std::vector<double> detect_ms, verify_ms, ocr_ms, total_ms;
+    int plates_correct = 0;
+    int chars_correct = 0;
+    int chars_total = 0;
+    int64 bench_start = cv::getTickCount();
+    for (size_t i = 0; i < files.size(); i++) {
+        cv::Mat img = cv::imread(files[i], 1);
+        if (img.empty()) {
+            std::cout << "Failed to read " << files[i] << std::endl;
+            continue;
+        }
+        std::string label = baseName(files[i]);
+
+        int64 t = cv::getTickCount();
+        std::vector<Plate> regions = detectRegions.run(img);
+        detect_ms.push_back(elapsedMs(t));
+        t = cv::getTickCount();
+        std::vector<Plate> plates = verifier.verify(regions);
+        verify_ms.push_back(elapsedMs(t));
+        t = cv::getTickCount();
+        ocr.run(plates);
+        ocr_ms.push_back(elapsedMs(t));
+        total_ms.push_back(detect_ms.back() + verify_ms.back() + ocr_ms.back());
+
+        // the best matching plate of the image counts
+        int best = 0;
+        for (size_t p = 0; p < plates.size(); p++) {
+            std::string s = plates[p].str();
+            int matches = 0;
+            for (size_t c = 0; c < std::min(s.size(), label.size()); c++) {
+                matches += (s[c] == label[c]) ? 1 : 0;
+            }
+            if (s == label) {
+                plates_correct++;
+                best = (int)label.size();
+                break;
+            }
+            best = std::max(best, matches);
+        }
+        chars_correct += best;
+        chars_total += (int)label.size();
+    }
+    double images_per_sec = files.empty() ? 0 :
+                            files.size() * 1000.0 / elapsedMs(bench_start);
+    double plate_accuracy = files.empty() ? 0 : (double)plates_correct / files.size();
+    double char_accuracy = chars_total ? (double)chars_correct / chars_total : 0;
+
+    // tiled region search against the whole image search: the share of the
+    // whole image regions the tiled search finds again (intersection over
+    // union of at least 0.5), outside the timing above
+    DetectRegions tiledRegions;
+    tiledRegions.tile_height = std::max(1, parser.get<int>("tile_height"));
+    int regions_total = 0;
+    int regions_matched = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        cv::Mat img = cv::imread(files[i], 1);
+        if (img.empty()) {
+            continue;
+        }
+        std::vector<Plate> whole = detectRegions.run(img);
+        std::vector<Plate> tiled = tiledRegions.run(img);
+        for (size_t w = 0; w < whole.size(); w++) {
+            bool matched = false;
+            for (size_t t = 0; t < tiled.size() && !matched; t++) {
+                double inter = (whole[w].position & tiled[t].position).area();
+                double uni = whole[w].position.area() + tiled[t].position.area() - inter;
+                matched = uni > 0 && inter / uni >= 0.5;
+            }
+            regions_matched += matched ? 1 : 0;
+        }
+        regions_total += (int)whole.size();
+        if ((int)whole.size() != (int)tiled.size()) {
+            std::cout << "Tiled search: " << tiled.size() << " regions, whole image " <<
+                         whole.size() << " in " << files[i] << std::endl;
+        }
+    }
+    double tiled_match = regions_total ? (double)regions_matched / regions_total : 1;
+
+    // classifier alone over held out character crops, one batch. The mlp
+    // and knn are trained on the other crops here, the dnn graph was trained
+    // on DNN_data/train and is scored on DNN_data/test
+    std::vector<cv::Mat> train_chars, test_chars;
+    std::vector<int> train_labels, test_labels;
+    for (int c = 0; c < OCR::num_chars; c++) {
+        std::string name(1, OCR::str_chars[c]);
+        std::vector<cv::Mat> crops;
+        if (ocr.method == OCR_DNN) {
+            crops = readCrops(data_dir + "/DNN_data/test/" + name, "*.jpg");
+        } else {
+            crops = readCrops(data_dir + "/chars/" + name, "*.jpg");
+        }
+        for (size_t i = 0; i < crops.size(); i++) {
+            cv::resize(crops[i], crops[i], cv::Size(ocr.char_size, ocr.char_size));
+            bool held_out = ocr.method == OCR_DNN || i % holdout == 0;
+            (held_out ? test_chars : train_chars).push_back(crops[i]);
+            (held_out ? test_labels : train_labels).push_back(c);
+        }
+    }
+    double classifier_accuracy = 0;
+    if (!test_chars.empty()) {
+        std::vector<int> responses;
+        if (ocr.method == OCR_DNN) {
+            responses = ocr.classifyBatch(cv::Mat(), test_chars);
+        } else if (!train_chars.empty()) {
+            // the default constructor has other character sizes than the
+            // crops were resized to
+            OCR held_out_ocr;
+            held_out_ocr.method = ocr.method;
+            held_out_ocr.char_size = ocr.char_size;
+            held_out_ocr.feature_size = ocr.feature_size;
+            cv::Mat train_samples, samples;
+            held_out_ocr.featuresBatch(train_chars, train_samples);
+            cv::Mat labels(train_labels, true);
+            if (ocr.method == OCR_KNN) {
+                held_out_ocr.trainKnn(train_samples, labels, 3);
+            } else {
+                held_out_ocr.train(train_samples, labels, 10);
+            }
+            held_out_ocr.featuresBatch(test_chars, samples);
+            responses = held_out_ocr.classifyBatch(samples, test_chars);
+        }
+        int correct = 0;
+        for (size_t i = 0; i < responses.size(); i++) {
+            correct += (responses[i] == test_labels[i]) ? 1 : 0;
+        }
+        classifier_accuracy = (double)correct / test_chars.size();
+    }
+
+    // verifier trained on all but the held out plate / non plate crops,
+    // which are scored in one batch each
+    std::vector<cv::Mat> plate_images = readCrops(data_dir + "/plate", "*.jpg");
+    std::vector<cv::Mat> noplate_images = readCrops(data_dir + "/noPlate", "*.jpg");
+    cv::Mat verifier_samples;
+    cv::Mat verifier_labels;
+    std::vector<Plate> plate_crops;
+    std::vector<Plate> noplate_crops;
+    for (size_t i = 0; i < plate_images.size() + noplate_images.size(); i++) {
+        bool is_plate = i < plate_images.size();
+        size_t n = is_plate ? i : i - plate_images.size();
+        const cv::Mat &img = is_plate ? plate_images[n] : noplate_images[n];
+        if (n % holdout == 0) {
+            (is_plate ? plate_crops : noplate_crops).push_back(Plate(img, cv::Rect()));
+        } else if (img.cols == PlateVerifier::image_width &&
+                   img.rows == PlateVerifier::image_height) {
+            cv::Mat row;
+            img.reshape(1, 1).convertTo(row, CV_32FC1);
+            verifier_samples.push_back(row);
+            verifier_labels.push_back(is_plate ? 1 : 0);
+        }
+    }
+    double verifier_accuracy = 0;
+    size_t num_crops = plate_crops.size() + noplate_crops.size();
+    if (num_crops > 0 && !verifier_samples.empty()) {
+        PlateVerifier held_out_verifier;
+        held_out_verifier.train(verifier_samples, verifier_labels);
+        size_t true_positives = held_out_verifier.verify(plate_crops).size();
+        size_t false_positives = held_out_verifier.verify(noplate_crops).size();
+        verifier_accuracy = (double)(true_positives + noplate_crops.size() -
+                                     false_positives) / num_crops;
+    }
+
+    std::cout << "Images: " << files.size() << ", " << images_per_sec << " images/sec" << std::endl;
+    std::cout << "Latency per image:" << std::endl;
+    printLatency("detect", detect_ms);
+    printLatency("verify", verify_ms);
+    printLatency("ocr", ocr_ms);
+    printLatency("total", total_ms);
+
+    // without OCR.xml (or the dnn graph) no character is read, so the OCR
+    // results say nothing about a change and are neither stored nor checked
+    bool ocr_ready = ocr.isReady();
+    if (!ocr_ready) {
+        std::cout << "OCR classifier not loaded, see --ocr and --dnn_model: " <<
+                     "plate and char accuracy are not checked" << std::endl;
+    }
+    bool classifier_ready = ocr_ready || ocr.method != OCR_DNN;
+
+    // the tolerances absorb machine noise on throughput and the odd
+    // flipped crop or still after retraining
+    const double throughput_tolerance = 0.2;
+    const double accuracy_tolerance = 0.02;
+    if (parser.get<bool>("write_baseline")) {
+        cv::FileStorage fs(baseline_file, cv::FileStorage::WRITE);
+        fs << "images_per_sec" << images_per_sec;
+        if (ocr_ready) {
+            fs << "plate_accuracy" << plate_accuracy;
+            fs << "char_accuracy" << char_accuracy;
+        }
+        if (classifier_ready) {
+            fs << "classifier_accuracy" << classifier_accuracy;
+        }
+        fs << "verifier_accuracy" << verifier_accuracy;
+        fs << "tiled_match" << tiled_match;
+        fs << "throughput_tolerance" << throughput_tolerance;
+        fs << "accuracy_tolerance" << accuracy_tolerance;
+        std::cout << "Baseline written to " << baseline_file << std::endl;
+        return 0;
+    }
+
+    cv::FileStorage fs(baseline_file, cv::FileStorage::READ);
+    if (!fs.isOpened()) {
+        std::cout << "Failed to open baseline " << baseline_file << std::endl;
+        return 1;
+    }
+    double throughput_slack = fs["throughput_tolerance"].empty() ? throughput_tolerance :
+                              (double)fs["throughput_tolerance"];
+    double accuracy_slack = fs["accuracy_tolerance"].empty() ? accuracy_tolerance :
+                            (double)fs["accuracy_tolerance"];
+    std::cout << "Results:" << std::endl;
+    bool ok = true;
+    ok &= check(fs, "images_per_sec", "images/sec", images_per_sec, throughput_slack, true);
+    if (ocr_ready) {
+        ok &= check(fs, "plate_accuracy", "plate accuracy", plate_accuracy, accuracy_slack);
+        ok &= check(fs, "char_accuracy", "char accuracy", char_accuracy, accuracy_slack);
+    }
+    if (classifier_ready) {
+        ok &= check(fs, "classifier_accuracy", "classifier accuracy", classifier_accuracy,
+                    accuracy_slack);
+    }
+    ok &= check(fs, "verifier_accuracy", "verifier accuracy", verifier_accuracy, accuracy_slack);
+    ok &= check(fs, "tiled_match", "tiled region match", tiled_match, accuracy_slack);
+    return ok ? 0 : 1;
+}
@@ -1,23 +1,53 @@
 #include "detect_regions.hpp"
 
-void DetectRegions::setFilename(std::string s) 
+#include <algorithm>
+#include <cmath>
+
+#include "pipeline_stats.hpp"
+
+void DetectRegions::setFilename(std::string s)
 {
     filename = s;
 }
 
-DetectRegions::DetectRegions() 
+void DetectRegions::setPlateHeightRange(int min_height, int max_height)
+{
+    min_plate_height = min_height;
+    max_plate_height = max_height;
+}
+
+// returns a size x type view into buf, buf is only reallocated to grow
+static cv::Mat bufferView(cv::Mat &buf, cv::Size size, int type)
+{
+    if (buf.type() != type || buf.cols < size.width || buf.rows < size.height) {
+        buf.create(std::max(buf.rows, size.height), std::max(buf.cols, size.width), type);
+    }
+    return buf(cv::Rect(cv::Point(0, 0), size));
+}
+
+DetectRegions::DetectRegions()
 {
     show_steps = false;
     save_regions = false;
+    plate_aspect = 4.7272; // car plate aspect, 52/11
+    aspect_error = 0.4;
+    min_plate_height = 15;
+    max_plate_height = 125;
+    coarse_width = 800;
+    tile_height = 0;
+    element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(17, 3));
+    result_resized.create(33, 144, CV_8UC3);
 }
 
-bool DetectRegions::verifySizes(cv::RotatedRect mr)
+bool DetectRegions::verifySizes(cv::RotatedRect mr, float scale)
 {
-    float error = 0.4;
-    float aspect = 4.7272; // car plate aspect, 52/11
-    // min and max area
-    int amin = 15*aspect*15;
-    int amax = 125*aspect*125;
+    float error = aspect_error;
+    float aspect = plate_aspect;
+    // min and max area, plate heights are given at full resolution
+    float hmin = min_plate_height * scale;
+    float hmax = max_plate_height * scale;
+    int amin = hmin*aspect*hmin;
+    int amax = hmax*aspect*hmax;
     // min and max aspect ratio
     float rmin = aspect - aspect*error;
     float rmax = aspect + aspect*error;
@@ -53,137 +83,277 @@ cv::Mat DetectRegions::histEq(cv::Mat in)
     return out;
 }
 
+void DetectRegions::findCandidates(const cv::Mat &gray, float scale, Workspace &ws,
+                                   std::vector<cv::RotatedRect> &rects, bool show)
+{
+    PipelineStats &stats = PipelineStats::instance();
+    {
+        ScopedTimer timer("sobel");
+        cv::blur(gray, ws.img_blur, cv::Size(5, 5));
+        cv::Sobel(ws.img_blur, ws.img_sobel, CV_8U, 1, 0, 3, 1, 0, cv::BORDER_DEFAULT);
+    }
+    if (show) {
+        cv::imshow("sobel", ws.img_sobel);
+    }
+
+    {
+        ScopedTimer timer("threshold");
+        cv::threshold(ws.img_sobel, ws.img_threshold, 0, 255, CV_THRESH_OTSU+
+                                                              CV_THRESH_BINARY);
+    }
+    if (show) {
+        cv::imshow("threshold", ws.img_threshold);
+    }
+
+    {
+        ScopedTimer timer("morphology");
+        cv::morphologyEx(ws.img_threshold, ws.img_threshold, CV_MOP_CLOSE, element);
+    }
+    if (show) {
+        cv::imshow("close", ws.img_threshold);
+    }
+
+    ScopedTimer timer("contours");
+    cv::findContours(ws.img_threshold, ws.contours, CV_RETR_EXTERNAL,
+                                                    CV_CHAIN_APPROX_NONE);
+
+    rects.clear();
+    for (size_t i = 0; i < ws.contours.size(); i++) {
+        cv::RotatedRect mr = cv::minAreaRect(ws.contours[i]);
+        if (verifySizes(mr, scale)) {
+            rects.push_back(mr);
+        }
+    }
+    stats.addCount("contours", ws.contours.size());
+}
+
+void DetectRegions::findCandidatesTiled(const cv::Mat &gray, float scale,
+                                        std::vector<cv::RotatedRect> &rects)
+{
+    // stripes overlap by the height of the bounding box of the biggest
+    // plate verifySizes() accepts at any rotation, which is its diagonal at
+    // the largest area and aspect, plus the radius of the blur, Sobel and
+    // close filters, so every plate lies completely inside at least one
+    // stripe. Steps of worker threads are never shown.
+    //
+    // Each stripe picks its own Otsu threshold on the Sobel image, so the
+    // candidates can differ from a whole frame search: a stripe of mostly
+    // flat road or sky gets a lower threshold and keeps weaker edges, a
+    // busy stripe a higher one. The benchmark reports how many whole frame
+    // detections the tiled search still finds.
+    float hmax = max_plate_height * scale;
+    float rmax = plate_aspect + plate_aspect * aspect_error;
+    float max_area = hmax * plate_aspect * hmax;
+    int overlap = cvCeil(std::sqrt(max_area * (rmax + 1.0f / rmax))) + 4;
+    int num_stripes = (gray.rows + tile_height - 1) / tile_height;
+    // one workspace per stripe, kept across calls
+    if (workspaces.size() < (size_t)num_stripes) {
+        workspaces.resize(num_stripes);
+    }
+    if (stripe_rects.size() < (size_t)num_stripes) {
+        stripe_rects.resize(num_stripes);
+    }
+
+    cv::parallel_for_(cv::Range(0, num_stripes), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            int y = i * tile_height;
+            int h = std::min(tile_height + overlap, gray.rows - y);
+            findCandidates(gray(cv::Rect(0, y, gray.cols, h)), scale, workspaces[i],
+                           stripe_rects[i]);
+            for (size_t j = 0; j < stripe_rects[i].size(); j++) {
+                stripe_rects[i][j].center.y += y;
+            }
+        }
+    });
+
+    // plates inside an overlap are found twice, and a plate cut by a stripe
+    // border may still pass verifySizes, keep the biggest of each group
+    std::vector<cv::RotatedRect> &all = all_rects;
+    all.clear();
+    for (int i = 0; i < num_stripes; i++) {
+        all.insert(all.end(), stripe_rects[i].begin(), stripe_rects[i].end());
+    }
+    std::sort(all.begin(), all.end(),
+              [](const cv::RotatedRect &a, const cv::RotatedRect &b) {
+                  return a.size.area() > b.size.area();
+              });
+    rects.clear();
+    for (size_t i = 0; i < all.size(); i++) {
+        bool duplicate = false;
+        for (size_t j = 0; j < rects.size() && !duplicate; j++) {
+            duplicate = rects[j].boundingRect().contains(all[i].center);
+        }
+        if (!duplicate) {
+            rects.push_back(all[i]);
+        }
+    }
+}
+
+bool DetectRegions::refineRegion(const cv::Mat &input, const cv::RotatedRect &coarse,
+                                 cv::RotatedRect &min_rect, cv::Mat &img_crop)
+{
+    cv::Rect img_rect(0, 0, input.cols, input.rows);
+    float min_size = (coarse.size.width < coarse.size.height) ?
+                    coarse.size.width:coarse.size.height;
+    min_size = min_size - min_size*0.5;
+    if (min_size < 1) {
+        return false;
+    }
+
+    // flood fill only a window around the candidate instead of the whole image
+    cv::Rect roi = coarse.boundingRect();
+    roi.x -= roi.width/2;
+    roi.y -= roi.height;
+    roi.width *= 2;
+    roi.height *= 3;
+    roi &= img_rect;
+    if (roi.area() == 0) {
+        return false;
+    }
+    cv::Mat img_roi = input(roi);
+
+    ScopedTimer flood_timer("flood_fill");
+    std::srand(time(NULL));
+    cv::Mat mask = bufferView(mask_buf, cv::Size(roi.width+2, roi.height+2), CV_8UC1);
+    mask = cv::Scalar::all(0);
+    int low_diff = 10;
+    int up_diff = 10;
+    int connectivity = 4;
+    int new_mask_val = 255;
+    int num_seeds = 10;
+    cv::Rect ccomp;
+    int flags = connectivity + (new_mask_val << 8) +  //CV_FLOODFILL_MASK_ONLY;
+        CV_FLOODFILL_FIXED_RANGE + CV_FLOODFILL_MASK_ONLY;
+    for (int j = 0; j < num_seeds; j++) {
+        cv::Point seed;
+        seed.x = coarse.center.x + rand() % (int)min_size - (min_size/2) - roi.x;
+        seed.y = coarse.center.y + rand() % (int)min_size - (min_size/2) - roi.y;
+        if (seed.x < 0 || seed.y < 0 || seed.x >= roi.width || seed.y >= roi.height) {
+            continue;
+        }
+        cv::floodFill(img_roi, mask, seed, cv::Scalar(255, 0, 0), &ccomp,
+                      cv::Scalar(low_diff, low_diff, low_diff),
+                      cv::Scalar(up_diff, up_diff, up_diff),
+                      flags);
+    }
+    if (show_steps) {
+        cv::imshow("mask", mask);
+    }
+
+    // mask is one pixel larger than the roi on each side
+    std::vector<cv::Point> &points_interest = points_buf;
+    cv::findNonZero(mask(cv::Rect(1, 1, roi.width, roi.height)), points_interest);
+    if (points_interest.empty()) {
+        return false;
+    }
+    min_rect = cv::minAreaRect(points_interest);
+    min_rect.center.x += roi.x;
+    min_rect.center.y += roi.y;
+    flood_timer.stop();
+
+    ScopedTimer rectify_timer("rectify");
+    float r = (float)min_rect.size.width / (float)min_rect.size.height;
+    float angle = min_rect.angle;
+    if ( r< 1) {
+        angle = 90 + angle;
+    }
+    cv::Size rect_size = min_rect.size;
+    if (r < 1) {
+        cv::swap(rect_size.width, rect_size.height);
+    }
+
+    // rotate only the window that holds the plate once it is upright
+    int radius = cvCeil(0.5f * std::sqrt((float)(rect_size.width*rect_size.width +
+                                          rect_size.height*rect_size.height))) + 2;
+    cv::Rect win(cvFloor(min_rect.center.x) - radius,
+                 cvFloor(min_rect.center.y) - radius, 2*radius, 2*radius);
+    win &= img_rect;
+    if (win.area() == 0) {
+        return false;
+    }
+    cv::Point2f win_center = min_rect.center - cv::Point2f(win.tl());
+    cv::Mat rot_mat = cv::getRotationMatrix2D(win_center, angle, 1);
+    cv::Mat img_rotated = bufferView(rotated_buf, win.size(), input.type());
+    cv::warpAffine(input(win), img_rotated, rot_mat, win.size(), CV_INTER_CUBIC);
+    img_crop = bufferView(crop_buf, rect_size, input.type());
+    cv::getRectSubPix(img_rotated, rect_size, win_center, img_crop);
+    return true;
+}
+
 std::vector<Plate> DetectRegions::segment(cv::Mat input)
 {
+    // every intermediate buffer is a member sized to the last input, only
+    // the returned plate images are allocated per call
     std::vector<Plate> output;
-    cv::Mat img_gray;
     cv::cvtColor(input, img_gray, cv::COLOR_BGR2GRAY);
-    cv::blur(img_gray, img_gray, cv::Size(5, 5));
-    
-    cv::Mat img_sobel;
-    cv::Sobel(img_gray, img_sobel, CV_8U, 1, 0, 3, 1, 0, cv::BORDER_DEFAULT);
-    if (show_steps) {
-        cv::imshow("sobel", img_sobel);
-    }
 
-    cv::Mat img_threshold;
-    cv::threshold(img_sobel, img_threshold, 0, 255, CV_THRESH_OTSU+
-                                                    CV_THRESH_BINARY);
-    
-    if (show_steps) {
-        cv::imshow("threshold", img_threshold);
+    // coarse pass on a downsampled image, the blur and close kernels are
+    // tuned for inputs about coarse_width pixels wide
+    float scale = 1.0f;
+    cv::Mat img_search = img_gray;
+    if (coarse_width > 0 && input.cols > coarse_width) {
+        scale = (float)coarse_width / (float)input.cols;
+        cv::Size small_size(coarse_width, cvRound(input.rows * scale));
+        cv::resize(img_gray, img_small, small_size, 0, 0, cv::INTER_AREA);
+        img_search = img_small;
     }
 
-    cv::Mat element = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(17, 3));
-    cv::morphologyEx(img_threshold, img_threshold, CV_MOP_CLOSE, element);
-    if (show_steps) {
-        cv::imshow("close", img_threshold);
-    }
-
-    std::vector<std::vector<cv::Point> > contours;
-    cv::findContours(img_threshold, contours, CV_RETR_EXTERNAL, 
-                                              CV_CHAIN_APPROX_NONE);
-    
-    std::vector<std::vector<cv::Point>>::iterator it = contours.begin();
-    std::vector<cv::RotatedRect> rects;
-    while (it != contours.end()) {
-        cv::RotatedRect mr = cv::minAreaRect(cv::Mat(*it));
-        if (!verifySizes(mr)) {
-            it = contours.erase(it);
-        } else {
-            ++it;
-            rects.push_back(mr);
+    if (tile_height > 0 && img_search.rows > tile_height) {
+        findCandidatesTiled(img_search, scale, rects);
+    } else {
+        if (workspaces.empty()) {
+            workspaces.resize(1);
         }
+        findCandidates(img_search, scale, workspaces[0], rects, show_steps);
     }
-    
-    std::cout << "Contour size: " << contours.size() << std::endl;
+    // back to full resolution coordinates
+    for (size_t i = 0; i < rects.size(); i++) {
+        rects[i].center.x /= scale;
+        rects[i].center.y /= scale;
+        rects[i].size.width /= scale;
+        rects[i].size.height /= scale;
+    }
+
+    PipelineStats::instance().addCount("candidates", rects.size());
+    // the visualization copy is only made when it is shown
     cv::Mat result;
-    input.copyTo(result);
-    cv::drawContours(result, contours, -1, cv::Scalar(255, 0, 0), 1);
+    if (show_steps) {
+        input.copyTo(result);
+    }
     for (int i = 0; i < rects.size(); i++) {
-        cv::circle(result, rects[i].center, 3, cv::Scalar(0, 255, 0), -1);
-        float min_size = (rects[i].size.width < rects[i].size.height) ? 
-                        rects[i].size.width:rects[i].size.height;
-        min_size = min_size - min_size*0.5;
-        std::srand(time(NULL));
-        cv::Mat mask;
-        mask.create(input.rows+2, input.cols+2, CV_8UC1);
-        mask = cv::Scalar::all(0);
-        int low_diff = 10;
-        int up_diff = 10;
-        int connectivity = 4;
-        int new_mask_val = 255;
-        int num_seeds = 10;
-        cv::Rect ccomp;
-        int flags = connectivity + (new_mask_val << 8) +  //CV_FLOODFILL_MASK_ONLY;
-            CV_FLOODFILL_FIXED_RANGE + CV_FLOODFILL_MASK_ONLY;
-        for (int j = 0; j < num_seeds; j++) {
-            cv::Point seed;
-            seed.x = rects[i].center.x + rand() % (int)min_size - (min_size/2);
-            seed.y = rects[i].center.y + rand() % (int)min_size - (min_size/2);
-            cv::circle(result, seed, 1, cv::Scalar(0, 255, 255), -1);
-            int area = cv::floodFill(input, mask, seed, cv::Scalar(255, 0, 0),
-                                     &ccomp,
-                                     cv::Scalar(low_diff, low_diff, low_diff),
-                                     cv::Scalar(up_diff, up_diff, up_diff),
-                                     flags);
-        }
         if (show_steps) {
-            cv::imshow("mask", mask);
+            cv::circle(result, rects[i].center, 3, cv::Scalar(0, 255, 0), -1);
         }
-        
-        std::vector<cv::Point> points_interest;
-        cv::Mat_<uchar>::iterator it = mask.begin<uchar>();
-        cv::Mat_<uchar>::iterator end = mask.end<uchar>();
-        for (; it != end; ++it) {
-            if (*it=255) {
-                points_interest.push_back(it.pos());
-            }
+
+        cv::RotatedRect min_rect;
+        cv::Mat img_crop;
+        if (!refineRegion(input, rects[i], min_rect, img_crop)) {
+            continue;
         }
-        
-        cv::RotatedRect min_rect = cv::minAreaRect(points_interest);
-        std::cout << "img size:" << input.cols<< " " << input.rows<< std::endl;
-        std::cout << "min_rect:" << min_rect.size.width << " " << min_rect.size.height  << std::endl;
+        PipelineStats::instance().addCount("refined", 1);
         if (1) {// verifySizes(min_rect)) {
-            std::cout << "verify min size" << std::endl;
-            cv::Point2f rect_points[4];
-            min_rect.points(rect_points);
-            for (int j = 0; j < 4; j++) {
-                cv::line(result, rect_points[j], rect_points[(j+1)%4], 
-                         cv::Scalar(0, 0, 255), 1, 8);
-            }
-            float r = (float)min_rect.size.width / (float)min_rect.size.height;
-            float angle = min_rect.angle;
-            if ( r< 1) {
-                angle = 90 + angle;
-            }
-            cv::Mat rot_mat = cv::getRotationMatrix2D(min_rect.center, angle, 1);
-            cv::Mat img_rotated;
-            cv::warpAffine(input, img_rotated, rot_mat, input.size(), CV_INTER_CUBIC);
-            
-            cv::Size rect_size = min_rect.size;
-            if (r < 1) {
-                cv::swap(rect_size.width, rect_size.height);
+            if (show_steps) {
+                cv::Point2f rect_points[4];
+                min_rect.points(rect_points);
+                for (int j = 0; j < 4; j++) {
+                    cv::line(result, rect_points[j], rect_points[(j+1)%4],
+                             cv::Scalar(0, 0, 255), 1, 8);
+                }
             }
 
-            cv::Mat img_crop;
-            cv::getRectSubPix(img_rotated, rect_size, min_rect.center, img_crop);
-
-            cv::Mat result_resized;
-            result_resized.create(33, 144, CV_8UC3);
-            cv::resize(img_crop, result_resized, result_resized.size(), 0, 0, 
+            cv::resize(img_crop, result_resized, result_resized.size(), 0, 0,
                                                             cv::INTER_CUBIC);
-            cv::Mat gray_result;
             cv::cvtColor(result_resized, gray_result, cv::COLOR_BGR2GRAY);
             cv::blur(gray_result, gray_result, cv::Size(3, 3));
-            gray_result = histEq(gray_result);
+            // the equalized image is owned by the plate
+            cv::Mat plate_img = histEq(gray_result);
             if (save_regions) {
                 std::stringstream ss(std::stringstream::in | std::stringstream::out);
                 ss << "tmp/" << filename << "_" << i << ".jpg";
-                cv::imwrite(ss.str(), gray_result);
+                cv::imwrite(ss.str(), plate_img);
             }
-            output.push_back(Plate(gray_result, min_rect.boundingRect()));
-        }   
+            output.push_back(Plate(plate_img, min_rect.boundingRect()));
+        }
     }
     if (show_steps) {
         cv::imshow("contours", result);
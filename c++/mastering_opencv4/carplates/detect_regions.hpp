@@ -15,16 +15,63 @@ class DetectRegions
 public:
     DetectRegions();
     void setFilename(std::string f);
+    void setPlateHeightRange(int min_height, int max_height);
     std::vector<Plate> run(cv::Mat input);
-    
+
     std::string filename;
     bool save_regions;
     bool show_steps;
-    
-private:    
+
+    // plate size limits in full resolution pixels
+    float plate_aspect;
+    float aspect_error;
+    int min_plate_height;
+    int max_plate_height;
+
+    // coarse-to-fine: inputs wider than this are searched at reduced
+    // resolution, candidates are refined on the full resolution input
+    int coarse_width;
+    // tiled mode: search images taller than this are split into
+    // overlapping horizontal stripes processed in parallel (0 disables).
+    // The binarization threshold is chosen per stripe, so the candidates
+    // are close to, but not always the same as, the whole image search.
+    int tile_height;
+
+private:
+   // search buffers, one set per stripe in tiled mode
+   struct Workspace
+   {
+       cv::Mat img_blur;
+       cv::Mat img_sobel;
+       cv::Mat img_threshold;
+       std::vector<std::vector<cv::Point> > contours;
+   };
+
    std::vector<Plate> segment(cv::Mat input);
-   bool verifySizes(cv::RotatedRect mr);
+   void findCandidates(const cv::Mat &gray, float scale, Workspace &ws,
+                       std::vector<cv::RotatedRect> &rects, bool show = false);
+   void findCandidatesTiled(const cv::Mat &gray, float scale,
+                            std::vector<cv::RotatedRect> &rects);
+   bool refineRegion(const cv::Mat &input, const cv::RotatedRect &coarse,
+                     cv::RotatedRect &min_rect, cv::Mat &img_crop);
+   bool verifySizes(cv::RotatedRect mr, float scale = 1.0f);
    cv::Mat histEq(cv::Mat in);
+
+   // buffers reused between calls, so a long running batch does not
+   // allocate per image once they reached the input size
+   cv::Mat element;
+   cv::Mat img_gray;
+   cv::Mat img_small;
+   std::vector<Workspace> workspaces;
+   std::vector<std::vector<cv::RotatedRect> > stripe_rects;
+   std::vector<cv::RotatedRect> all_rects;
+   std::vector<cv::RotatedRect> rects;
+   cv::Mat mask_buf;
+   std::vector<cv::Point> points_buf;
+   cv::Mat rotated_buf;
+   cv::Mat crop_buf;
+   cv::Mat result_resized;
+   cv::Mat gray_result;
 };
 
-#endif 
+#endif
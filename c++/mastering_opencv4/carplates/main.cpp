@@ -3,6 +3,10 @@
 
 #include "detect_regions.hpp"
 #include "ocr.hpp"
+#include "pipeline_stats.hpp"
+#include "plate_tracker.hpp"
+#include "plate_verifier.hpp"
+#include "svm_dataset.hpp"
 
 #include <opencv2/opencv.hpp>
 
@@ -25,45 +29,105 @@ std::string getFilename(std::string s)
     }
 }
 
+int runVideo(std::string filename, PlateVerifier &verifier, int detect_interval)
+{
+    cv::VideoCapture cap(filename);
+    if (!cap.isOpened()) {
+        std::cout << "Failed to open " << filename << std::endl;
+        return 1;
+    }
+    DetectRegions detectRegions;
+    detectRegions.setFilename(getFilename(filename));
+    OCR ocr("OCR.xml");
+    ocr.filename = getFilename(filename);
+    PlateTracker tracker;
+
+    // full localization and OCR every detect_interval frames, the tracker
+    // carries the plates in between and votes on their readings
+    cv::Mat frame;
+    for (int n = 0; cap.read(frame); n++) {
+        tracker.predict();
+        if (n % detect_interval == 0) {
+            std::vector<Plate> plates = verifier.verify(detectRegions.run(frame));
+            ocr.run(plates);
+            tracker.update(plates);
+            std::vector<std::string> confirmed = tracker.confirmed();
+            for (size_t i = 0; i < confirmed.size(); i++) {
+                std::cout << "License plate number: " << confirmed[i] << std::endl;
+            }
+        }
+        for (size_t i = 0; i < tracker.tracks.size(); i++) {
+            const TrackedPlate &track = tracker.tracks[i];
+            cv::rectangle(frame, track.box, cv::Scalar(0, 0, 200));
+            cv::putText(frame, track.best(), track.box.tl(), cv::FONT_HERSHEY_SIMPLEX,
+                        1, cv::Scalar(0, 0, 200), 2);
+        }
+        cv::imshow("plates tracked", frame);
+        if (cv::waitKey(1) == 27) {
+            break;
+        }
+    }
+    std::vector<std::string> remaining = tracker.flush();
+    for (size_t i = 0; i < remaining.size(); i++) {
+        std::cout << "License plate number: " << remaining[i] << std::endl;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     std::cout << "OpenCV Automatic Number Plate Recognition" << std::endl;
     char *filename;
     cv::Mat input_image;
+    int detect_interval = 5;
+    std::string stats_file;
 
     if (argc >=2) {
         filename = argv[1];
         input_image = cv::imread(filename, 1);
+        for (int a = 2; a < argc; a++) {
+            std::string arg = argv[a];
+            if (arg.size() > 5 && arg.compare(arg.size()-5, 5, ".json") == 0) {
+                stats_file = arg;
+            } else {
+                detect_interval = std::max(1, atoi(argv[a]));
+            }
+        }
     } else {
-        printf("Use:\n %s image \n", argv[0]);
+        printf("Use:\n %s image [stats.json] \n"
+               " %s video [detect every n frames] [stats.json] \n",
+               argv[0], argv[0]);
         return 0;
     }
+    // per stage timings and the candidate funnel are only collected on request
+    PipelineStats::instance().enabled = !stats_file.empty();
     
-    cv::FileStorage fs;
-    fs.open("svm.xml", cv::FileStorage::READ);
+    // prefer the binary dataset, it is mapped instead of parsed
+    SvmDataset svm_dataset;
     cv::Mat svm_training_data;
     cv::Mat svm_training_label;
-    fs["training_data"] >> svm_training_data;
-    fs["training_labels"] >> svm_training_label;
+    if (svm_dataset.open("svm.bin")) {
+        svm_training_data = svm_dataset.data;
+        svm_training_label = svm_dataset.labels;
+    } else {
+        cv::FileStorage fs;
+        fs.open("svm.xml", cv::FileStorage::READ);
+        fs["training_data"] >> svm_training_data;
+        fs["training_labels"] >> svm_training_label;
+    }
     std::cout << "Successfully load SVM training data" << std::endl;
-    cv::Ptr<cv::ml::SVM> svm_classifier = cv::ml::SVM::create();
-    svm_classifier->setType(cv::ml::SVM::C_SVC);
-    svm_classifier->setKernel(cv::ml::SVM::LINEAR);
-    svm_classifier->setDegree(0.0);
-    svm_classifier->setGamma(1.0);
-    svm_classifier->setCoef0(0);
-    svm_classifier->setC(1);
-    svm_classifier->setNu(0.0);
-    svm_classifier->setP(0);
-    svm_classifier->setTermCriteria(
-            cv::TermCriteria(cv::TermCriteria::MAX_ITER, 1000, 0.01));
-    
-    cv::Ptr<cv::ml::TrainData> train_data = cv::ml::TrainData::create(svm_training_data,
-                                                      cv::ml::ROW_SAMPLE,
-                                                      svm_training_label);
-    svm_classifier->train(train_data);
+    PlateVerifier verifier;
+    verifier.train(svm_training_data, svm_training_label);
     std::cout <<"Finished training SVM classifier" << std::endl;
-    
+
+    // anything imread can not decode is treated as a video stream
+    if (input_image.empty()) {
+        int ret = runVideo(filename, verifier, detect_interval);
+        if (!stats_file.empty()) {
+            PipelineStats::instance().writeJson(stats_file);
+        }
+        return ret;
+    }
 
     std::string filename_no_ext = getFilename(filename);
     std::cout << "working with file: " << filename_no_ext << std::endl;
@@ -73,19 +137,34 @@ int main(int argc, char **argv)
     detectRegions.show_steps = true;
     std::vector<Plate> possible_regions = detectRegions.run(input_image);
     std::cout << "Num possible regions: " << possible_regions.size() << std::endl;
-    std::vector<Plate> plates;
     for (int i = 0; i < possible_regions.size(); i++) {
-        cv::Mat img = possible_regions[i].plate_img;
-        cv::imshow("candicate plate", img);
+        cv::imshow("candicate plate", possible_regions[i].plate_img);
         cv::waitKey(0);
-        cv::Mat p = img.reshape(1, 1);
-        p.convertTo(p, CV_32FC1);
-        int response = (int)svm_classifier->predict(p);
-        if (response == 1) {
-            plates.push_back(possible_regions[i]);
-        }
     }
+    std::vector<Plate> plates = verifier.verify(possible_regions);
     std::cout << "Num plates detected: " << plates.size() << std::endl;
+
+    // all characters of all plates are classified in one batch
+    OCR ocr("OCR.xml");
+    ocr.save_segments = false;
+    ocr.DEBUG = false;
+    ocr.filename = filename_no_ext;
+    ocr.run(plates);
+    for (int i = 0; i < plates.size(); i++) {
+        if (plates[i].chars.empty()) {
+            continue;
+        }
+        std::string license = plates[i].str();
+        std::cout << "License plate number: " << license << std::endl;
+        cv::rectangle(input_image, plates[i].position, cv::Scalar(0, 0, 200));
+        cv::putText(input_image, license, cv::Point(plates[i].position.x,
+                    plates[i].position.y), cv::FONT_HERSHEY_SIMPLEX, 1,
+                    cv::Scalar(0, 0, 200), 2);
+    }
+    if (!stats_file.empty()) {
+        PipelineStats::instance().writeJson(stats_file);
+    }
+    cv::imshow("plates detected", input_image);
     cv::waitKey(0);
     return 0;
 
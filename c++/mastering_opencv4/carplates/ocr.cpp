@@ -1,5 +1,7 @@
 #include "ocr.hpp"
 
+#include "pipeline_stats.hpp"
+
 const char OCR::str_chars[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', 
                                     '9', 'B', 'C', 'D', 'F', 'G', 'H', 'J', 'K',
                                     'L', 'M', 'N', 'P', 'R', 'S', 'T', 'V', 'W',
@@ -19,14 +21,20 @@ OCR::OCR()
     trained = false;
     save_segments = false;
     char_size = 30;
+    feature_size = 15;
+    method = OCR_MLP;
+    K = 3;
 }
 
-OCR::OCR(std::string train_file)
+OCR::OCR(std::string train_file, int method, std::string dnn_model)
 {
     DEBUG = false;
     trained = false;
     save_segments = false;
     char_size = 20;
+    feature_size = 15;
+    this->method = method;
+    K = 3;
 
     cv::FileStorage fs;
     fs.open(train_file, cv::FileStorage::READ);
@@ -36,13 +44,33 @@ OCR::OCR(std::string train_file)
     fs["training_data_f15"] >> training_data;
     fs["classes"] >> labels;
 
-    train(training_data, labels, 10);
-
-    dnn_net = cv::dnn::readNetFromTensorflow("model.pb");
+    // only the selected classifier is loaded, characters stay unread if
+    // it is not available
+    if (method == OCR_DNN) {
+        if (dnn_model.empty()) {
+            std::cout << "No OCR dnn model given" << std::endl;
+        } else {
+            dnn_net = cv::dnn::readNetFromTensorflow(dnn_model);
+        }
+    } else if (training_data.empty()) {
+        std::cout << "Failed to read OCR training data from " << train_file << std::endl;
+    } else if (method == OCR_KNN) {
+        trainKnn(training_data, labels, K);
+    } else {
+        train(training_data, labels, 10);
+    }
 }
 
 cv::Mat OCR::preprocessChar(cv::Mat in)
 {
+    cv::Mat out(char_size, char_size, in.type());
+    preprocessChar(in, out);
+    return out;
+}
+
+void OCR::preprocessChar(cv::Mat in, cv::Mat out)
+{
+    // out is a char_size x char_size view, e.g. a row of the batch
     int h = in.rows;
     int w = in.cols;
     cv::Mat trans_mat = cv::Mat::eye(2, 3, CV_32F);
@@ -53,33 +81,28 @@ cv::Mat OCR::preprocessChar(cv::Mat in)
     cv::Mat warp_image(m, m, in.type());
     cv::warpAffine(in, warp_image, trans_mat, warp_image.size(), cv::INTER_LINEAR,
                     cv::BORDER_CONSTANT, cv::Scalar(0));
-    cv::Mat out;
-    cv::resize(warp_image, out, cv::Size(char_size, char_size));
-
-    return out;
+    cv::resize(warp_image, out, out.size());
 }
 
-bool OCR::verifySizes(cv::Mat r)
+bool OCR::verifySizes(cv::Rect r, int area)
 {
     float aspect = 45.0f/77.0f;
-    float char_aspect = (float)r.cols / (float)r.rows;
+    float char_aspect = (float)r.width / (float)r.height;
     float error = 0.35;
     float min_height = 15;
     float max_height = 28;
     float min_aspect = 0.2;
     float max_aspect = aspect+aspect*error;
-    float area = countNonZero(r);
-    float bb_area = r.cols*r.rows;
-    float perc_pixels = area/bb_area;
+    float bb_area = r.width*r.height;
     float per_pixels = area/bb_area;
     
     if (DEBUG) {
         std::cout << "Aspect: " << aspect << " [" << min_aspect << "," << 
             max_aspect << "] " << "Area " << per_pixels << " Char aspect " <<
-            char_aspect << " Height char " << r.rows << "\n";
+            char_aspect << " Height char " << r.height << "\n";
     }
     if (per_pixels < 0.8 && char_aspect > min_aspect && char_aspect < max_aspect
-        && r.rows >= min_height && r.rows < max_height) {
+        && r.height >= min_height && r.height < max_height) {
         return true;
     } else {
         return false;
@@ -87,37 +110,39 @@ bool OCR::verifySizes(cv::Mat r)
 
 }
 
-std::vector<CharSegment> OCR::segment(Plate plate)
+std::vector<cv::Rect> OCR::segment(const Plate &plate, cv::Mat &img_threshold)
 {
     cv::Mat input = plate.plate_img;
-    std::vector<CharSegment> output;
-    cv::Mat img_threshold;
+    std::vector<cv::Rect> output;
     cv::threshold(input, img_threshold, 60, 255, CV_THRESH_BINARY_INV);
 
     if (DEBUG) {
         cv::imshow("threshold plate", img_threshold);
     }
 
-    cv::Mat img_contours;
-    img_threshold.copyTo(img_contours);
-    std::vector<std::vector<cv::Point>> contours;
-    cv::findContours(img_contours, contours, CV_RETR_EXTERNAL,
-                                             CV_CHAIN_APPROX_NONE);
+    // bounding box and area of every blob from a single labeling pass
+    cv::Mat labels;
+    cv::Mat stats;
+    cv::Mat centroids;
+    int num_labels = cv::connectedComponentsWithStats(img_threshold, labels, stats,
+                                                      centroids, 8, CV_32S);
     cv::Mat result;
-    img_threshold.copyTo(result);
-    cv::cvtColor(result, result, cv::COLOR_BGR2RGB);
-    cv::drawContours(result, contours, -1, cv::Scalar(255, 0, 0), 1);
-    std::vector<std::vector<cv::Point>>::iterator it = contours.begin();
-    while (it!=contours.end()) {
-        cv::Rect mr = boundingRect(cv::Mat(*it));
-        cv::rectangle(result, mr, cv::Scalar(0, 255, 0));
-        cv::Mat aux_ROI(img_threshold, mr);
-        if (verifySizes(aux_ROI)) {
-            aux_ROI = preprocessChar(aux_ROI);
-            output.push_back(CharSegment(aux_ROI, mr));
-            cv::rectangle(result, mr, cv::Scalar(0, 125, 255));
+    if (DEBUG) {
+        cv::cvtColor(img_threshold, result, cv::COLOR_GRAY2RGB);
+    }
+    // label 0 is the background
+    for (int i = 1; i < num_labels; i++) {
+        const int *stat = stats.ptr<int>(i);
+        cv::Rect mr(stat[cv::CC_STAT_LEFT], stat[cv::CC_STAT_TOP],
+                    stat[cv::CC_STAT_WIDTH], stat[cv::CC_STAT_HEIGHT]);
+        bool valid = verifySizes(mr, stat[cv::CC_STAT_AREA]);
+        if (valid) {
+            output.push_back(mr);
+        }
+        if (DEBUG) {
+            cv::rectangle(result, mr, valid ? cv::Scalar(0, 125, 255) :
+                                              cv::Scalar(0, 255, 0));
         }
-        ++it;
     }
     if (DEBUG) {
         std::cout << "Num chars: " <<output.size() << std::endl;
@@ -128,12 +153,12 @@ std::vector<CharSegment> OCR::segment(Plate plate)
 
 cv::Mat OCR::projectHistogram(cv::Mat img, int t)
 {
-    int size = (t)? img.rows: img.cols;
-    cv::Mat mhist = cv::Mat::zeros(1, size, CV_32F);
-    for (int j = 0; j < size; j++) {
-        cv::Mat data = (t)?img.row(j):img.col(j);
-        mhist.at<float>(j) = countNonZero(data);
-    }
+    // count non zero pixels of every row (or column) with one reduce
+    cv::Mat img_bin;
+    cv::threshold(img, img_bin, 0, 1, CV_THRESH_BINARY);
+    cv::Mat mhist;
+    cv::reduce(img_bin, mhist, (t)? 1: 0, CV_REDUCE_SUM, CV_32F);
+    mhist = mhist.reshape(1, 1);
     double min, max;
     cv::minMaxLoc(mhist, &min, &max);
 
@@ -192,8 +217,298 @@ cv::Mat OCR::getVisualHistogram(cv::Mat *hist, int type)
     return im_hist;
 }
 
-    
+void OCR::drawVisualFeatures(cv::Mat character, cv::Mat hhist, cv::Mat vhist,
+                                                cv::Mat low_data)
+{
+    int n = character.cols;
+    cv::Mat img(n+101, n+101, CV_8UC3, cv::Scalar(0, 0, 0));
+    cv::Mat ch;
+    cv::Mat ld;
+    cv::cvtColor(character, ch, cv::COLOR_GRAY2RGB);
+    cv::resize(low_data, ld, cv::Size(100, 100), 0, 0, cv::INTER_NEAREST);
+    cv::cvtColor(ld, ld, cv::COLOR_GRAY2RGB);
+
+    cv::Mat hh = getVisualHistogram(&hhist, HORIZONTAL);
+    cv::Mat hv = getVisualHistogram(&vhist, VERTICAL);
+
+    ch.copyTo(img(cv::Rect(0, 101, n, n)));
+    hh(cv::Rect(0, 0, 100, n)).copyTo(img(cv::Rect(n+1, 101, 100, n)));
+    hv(cv::Rect(0, 0, n, 100)).copyTo(img(cv::Rect(0, 0, n, 100)));
+    ld.copyTo(img(cv::Rect(n+1, 0, 100, 100)));
+
+    cv::line(img, cv::Point(0, 100), cv::Point(n+101, 100), cv::Scalar(0, 0, 255));
+    cv::line(img, cv::Point(n, 0), cv::Point(n, n+101), cv::Scalar(0, 0, 255));
+
+    cv::imshow("visual features", img);
+    cv::waitKey(0);
+}
+
+cv::Mat OCR::features(cv::Mat in, int size)
+{
+    // histogram features
+    cv::Mat vhist = projectHistogram(in, VERTICAL);
+    cv::Mat hhist = projectHistogram(in, HORIZONTAL);
 
-                                        
+    // low resolution image feature
+    cv::Mat low_data;
+    cv::resize(in, low_data, cv::Size(size, size));
+
+    if (DEBUG) {
+        drawVisualFeatures(in, hhist, vhist, low_data);
+    }
+
+    int num_cols = vhist.cols + hhist.cols + low_data.cols*low_data.cols;
+    cv::Mat out = cv::Mat::zeros(1, num_cols, CV_32F);
+    int j = 0;
+    for (int i = 0; i < vhist.cols; i++) {
+        out.at<float>(j) = vhist.at<float>(i);
+        j++;
+    }
+    for (int i = 0; i < hhist.cols; i++) {
+        out.at<float>(j) = hhist.at<float>(i);
+        j++;
+    }
+    for (int x = 0; x < low_data.cols; x++) {
+        for (int y = 0; y < low_data.rows; y++) {
+            out.at<float>(j) = (float)low_data.at<uchar>(x, y);
+            j++;
+        }
+    }
+    return out;
+}
+
+void OCR::featuresBatch(const std::vector<cv::Mat> &chars, cv::Mat &samples)
+{
+    // same layout as features(): vertical histogram, horizontal histogram
+    // and the low resolution image, one row per character
+    int n = (int)chars.size();
+    int s = char_size;
+    int f = feature_size;
+    samples.create(n, 2*s + f*f, CV_32F);
+
+    // all characters stacked in one contiguous binary image
+    cv::Mat batch(n*s, s, CV_8U);
+    cv::Mat low_data;
+    for (int i = 0; i < n; i++) {
+        CV_Assert(chars[i].rows == s && chars[i].cols == s);
+        cv::Mat ch = batch(cv::Rect(0, i*s, s, s));
+        cv::threshold(chars[i], ch, 0, 1, CV_THRESH_BINARY);
+        cv::resize(chars[i], low_data, cv::Size(f, f));
+        low_data.reshape(1, 1).convertTo(samples(cv::Rect(2*s, i, f*f, 1)), CV_32F);
+    }
+
+    // a single integral image of the batch gives both projections, row
+    // sums from its last column and column sums from the rows at the
+    // character borders
+    cv::Mat sum;
+    cv::integral(batch, sum, CV_32S);
+    for (int i = 0; i < n; i++) {
+        float *out = samples.ptr<float>(i);
+        const int *top = sum.ptr<int>(i*s);
+        const int *bottom = sum.ptr<int>((i+1)*s);
+        for (int c = 0; c < s; c++) {
+            out[c] = (float)(bottom[c+1] - bottom[c] - top[c+1] + top[c]);
+        }
+        for (int r = 0; r < s; r++) {
+            out[s+r] = (float)(sum.at<int>(i*s+r+1, s) - sum.at<int>(i*s+r, s));
+        }
+
+        cv::Mat vhist(1, s, CV_32F, out);
+        cv::Mat hhist(1, s, CV_32F, out + s);
+        double min, max;
+        cv::minMaxLoc(vhist, &min, &max);
+        if (max > 0) {
+            vhist *= 1.0f/max;
+        }
+        cv::minMaxLoc(hhist, &min, &max);
+        if (max > 0) {
+            hhist *= 1.0f/max;
+        }
+
+        if (DEBUG) {
+            cv::resize(chars[i], low_data, cv::Size(f, f));
+            drawVisualFeatures(chars[i], hhist, vhist, low_data);
+        }
+    }
+}
+
+void OCR::train(cv::Mat train_data, cv::Mat train_label, int n_layers)
+{
+    cv::Mat layers(1, 3, CV_32SC1);
+    layers.at<int>(0) = train_data.cols;
+    layers.at<int>(1) = n_layers;
+    layers.at<int>(2) = num_chars;
 
+    ann = cv::ml::ANN_MLP::create();
+    ann->setLayerSizes(layers);
+    ann->setActivationFunction(cv::ml::ANN_MLP::SIGMOID_SYM, 1, 1);
+    ann->setTrainMethod(cv::ml::ANN_MLP::BACKPROP, 0.0001);
 
+    // one output neuron per character
+    cv::Mat train_classes = cv::Mat::zeros(train_data.rows, num_chars, CV_32FC1);
+    for (int i = 0; i < train_classes.rows; i++) {
+        train_classes.at<float>(i, train_label.at<int>(i)) = 1;
+    }
+
+    cv::Ptr<cv::ml::TrainData> data = cv::ml::TrainData::create(train_data,
+                                                        cv::ml::ROW_SAMPLE,
+                                                        train_classes);
+    ann->train(data);
+    trained = true;
+}
+
+int OCR::classify(cv::Mat f)
+{
+    if (ann.empty() || !ann->isTrained()) {
+        return -1;
+    }
+    cv::Mat output(1, num_chars, CV_32FC1);
+    ann->predict(f, output);
+    cv::Point max_loc;
+    double max_val;
+    cv::minMaxLoc(output, 0, &max_val, 0, &max_loc);
+    return max_loc.x;
+}
+
+void OCR::trainKnn(cv::Mat train_samples, cv::Mat train_labels, int k)
+{
+    K = k;
+    knn = cv::ml::KNearest::create();
+    knn->setDefaultK(K);
+    knn->setIsClassifier(true);
+    knn->train(train_samples, cv::ml::ROW_SAMPLE, train_labels);
+    trained = true;
+}
+
+int OCR::classifyKnn(cv::Mat f)
+{
+    if (knn.empty() || !knn->isTrained()) {
+        return -1;
+    }
+    cv::Mat results;
+    knn->findNearest(f, K, results);
+    return cvRound(results.at<float>(0));
+}
+
+bool OCR::isReady() const
+{
+    if (method == OCR_KNN) {
+        return !knn.empty() && knn->isTrained();
+    }
+    if (method == OCR_DNN) {
+        return !dnn_net.empty();
+    }
+    return !ann.empty() && ann->isTrained();
+}
+
+std::vector<int> OCR::classifyBatch(cv::Mat samples, const std::vector<cv::Mat> &chars)
+{
+    // samples holds one feature row per character, chars the preprocessed
+    // character images in the same order (only used by the dnn)
+    cv::Mat output;
+    if (!isReady()) {
+        // -1 leaves the character unread
+        return std::vector<int>(std::max(samples.rows, (int)chars.size()), -1);
+    }
+    if (method == OCR_KNN) {
+        knn->findNearest(samples, K, output);
+        std::vector<int> responses(output.rows);
+        for (int i = 0; i < output.rows; i++) {
+            responses[i] = cvRound(output.at<float>(i));
+        }
+        return responses;
+    }
+
+    if (method == OCR_DNN) {
+        cv::Mat blob = cv::dnn::blobFromImages(chars, 1.0f/255.0f, cv::Size(char_size, char_size),
+                                               cv::Scalar(), false, false);
+        dnn_net.setInput(blob);
+        output = dnn_net.forward().reshape(1, (int)chars.size());
+    } else {
+        ann->predict(samples, output);
+    }
+
+    // one row of class scores per character
+    std::vector<int> responses(output.rows);
+    for (int i = 0; i < output.rows; i++) {
+        cv::Point max_loc;
+        cv::minMaxLoc(output.row(i), 0, 0, 0, &max_loc);
+        responses[i] = max_loc.x;
+    }
+    return responses;
+}
+
+void OCR::run(std::vector<Plate> &input)
+{
+    // segment every plate first, then classify all characters of all
+    // plates with a single predict/forward call
+    ScopedTimer segment_timer("ocr_segment");
+    for (size_t p = 0; p < input.size(); p++) {
+        input[p].chars.clear();
+        input[p].chars_pos.clear();
+    }
+    std::vector<cv::Mat> thresholds(input.size());
+    std::vector<int> owner;
+    std::vector<cv::Rect> positions;
+    for (size_t p = 0; p < input.size(); p++) {
+        std::vector<cv::Rect> rects = segment(input[p], thresholds[p]);
+        for (size_t i = 0; i < rects.size(); i++) {
+            owner.push_back((int)p);
+            positions.push_back(rects[i]);
+        }
+    }
+    int total = (int)positions.size();
+    if (total == 0) {
+        return;
+    }
+
+    // normalized crops are written straight into the batch, one row per
+    // character, which is only reallocated when it has to grow
+    if (char_batch.rows < total || char_batch.cols != char_size*char_size) {
+        char_batch.create(total, char_size*char_size, CV_8U);
+    }
+    std::vector<cv::Mat> chars(total);
+    for (int i = 0; i < total; i++) {
+        chars[i] = char_batch.row(i).reshape(1, char_size);
+        preprocessChar(thresholds[owner[i]](positions[i]), chars[i]);
+        if (save_segments) {
+            std::stringstream ss(std::stringstream::in | std::stringstream::out);
+            ss << "tmp/chars/" << filename << "_" << owner[i] << "_" << i << ".jpg";
+            cv::imwrite(ss.str(), chars[i]);
+        }
+    }
+
+    segment_timer.stop();
+    PipelineStats::instance().addCount("chars", total);
+
+    cv::Mat samples;
+    if (method != OCR_DNN) {
+        ScopedTimer timer("ocr_features");
+        featuresBatch(chars, samples);
+    }
+
+    ScopedTimer classify_timer("ocr_classify");
+    std::vector<int> responses = classifyBatch(samples, chars);
+    classify_timer.stop();
+    for (size_t i = 0; i < responses.size(); i++) {
+        if (responses[i] < 0 || responses[i] >= num_chars) {
+            continue;
+        }
+        Plate &plate = input[owner[i]];
+        plate.chars.push_back(str_chars[responses[i]]);
+        plate.chars_pos.push_back(positions[i]);
+    }
+    int read = 0;
+    for (size_t p = 0; p < input.size(); p++) {
+        read += input[p].chars.empty() ? 0 : 1;
+    }
+    PipelineStats::instance().addCount("read", read);
+}
+
+std::string OCR::run(Plate *input)
+{
+    std::vector<Plate> plates(1, *input);
+    run(plates);
+    *input = plates[0];
+    return input->str();
+}
@@ -11,6 +11,11 @@
 #define HORIZONTAL 1
 #define VERTICAL 0
 
+// character classifiers
+#define OCR_MLP 0
+#define OCR_KNN 1
+#define OCR_DNN 2
+
 class CharSegment
 {
 public:
@@ -24,35 +29,46 @@ class OCR
 {
 public:
     OCR();
-    OCR(std::string train_file);
+    // train_file holds the MLP / KNN training data, dnn_model the
+    // tensorflow graph used with OCR_DNN
+    OCR(std::string train_file, int method = OCR_MLP, std::string dnn_model = "");
     std::string run(Plate *input);
+    void run(std::vector<Plate> &input);
     cv::Mat preprocessChar(cv::Mat in);
+    void preprocessChar(cv::Mat in, cv::Mat out);
     int classify(cv::Mat in);
+    std::vector<int> classifyBatch(cv::Mat samples, const std::vector<cv::Mat> &chars);
+    // whether the classifier selected by method is trained or loaded
+    bool isReady() const;
     void train(cv::Mat train_data, cv::Mat train_label, int n_layers);
     int classifyKnn(cv::Mat in);
     void trainKnn(cv::Mat train_samples, cv::Mat train_labels, int k);
     cv::Mat features(cv::Mat intput, int size);
+    void featuresBatch(const std::vector<cv::Mat> &chars, cv::Mat &samples);
 
     bool DEBUG;
     bool save_segments;
     std::string filename;
     int char_size;
+    int feature_size;
+    int method;
     static const int num_chars;
     static const char str_chars[];
 
 private:
     bool trained;
-    std::vector<CharSegment> segment(Plate in);
+    std::vector<cv::Rect> segment(const Plate &in, cv::Mat &img_threshold);
     cv::Mat preprocess(cv::Mat in, int new_size);
     cv::Mat getVisualHistogram(cv::Mat *hist, int type);
     void drawVisualFeatures(cv::Mat character, cv::Mat hhist, cv::Mat vhist,
                                                               cv::Mat low_data);
     cv::Mat projectHistogram(cv::Mat img, int t);
-    bool verifySizes(cv::Mat in);
+    bool verifySizes(cv::Rect r, int area);
     cv::Ptr<cv::ml::ANN_MLP> ann;
     cv::Ptr<cv::ml::KNearest> knn;
     cv::dnn::Net dnn_net;
     int K;
+    cv::Mat char_batch;
 };
 
 #endif
@@ -0,0 +1,107 @@
+#include "pipeline_stats.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+PipelineStats &PipelineStats::instance()
+{
+    static PipelineStats stats;
+    return stats;
+}
+
+PipelineStats::PipelineStats()
+{
+    enabled = false;
+    funnel.push_back("contours");
+    funnel.push_back("candidates");
+    funnel.push_back("refined");
+    funnel.push_back("verified");
+    funnel.push_back("read");
+}
+
+void PipelineStats::addTime(const std::string &stage, double ms)
+{
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::map<std::string, StageTime>::iterator it = times.find(stage);
+    if (it == times.end()) {
+        StageTime t = {1, ms, ms};
+        times[stage] = t;
+    } else {
+        it->second.calls++;
+        it->second.total_ms += ms;
+        it->second.max_ms = std::max(it->second.max_ms, ms);
+    }
+}
+
+void PipelineStats::addCount(const std::string &counter, long n)
+{
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    counts[counter] += n;
+}
+
+void PipelineStats::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    times.clear();
+    counts.clear();
+}
+
+bool PipelineStats::writeJson(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream out(path.c_str());
+    if (!out) {
+        return false;
+    }
+    out << "{\n  \"stages\": {";
+    std::map<std::string, StageTime>::const_iterator t = times.begin();
+    for (; t != times.end(); ++t) {
+        out << (t == times.begin() ? "\n" : ",\n");
+        out << "    \"" << t->first << "\": {\"calls\": " << t->second.calls <<
+               ", \"total_ms\": " << t->second.total_ms <<
+               ", \"mean_ms\": " << t->second.total_ms / t->second.calls <<
+               ", \"max_ms\": " << t->second.max_ms << "}";
+    }
+    out << "\n  },\n  \"counts\": {";
+    std::map<std::string, long>::const_iterator c = counts.begin();
+    for (; c != counts.end(); ++c) {
+        out << (c == counts.begin() ? "\n" : ",\n");
+        out << "    \"" << c->first << "\": " << c->second;
+    }
+    out << "\n  },\n  \"funnel\": [";
+    for (size_t i = 0; i < funnel.size(); i++) {
+        std::map<std::string, long>::const_iterator it = counts.find(funnel[i]);
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\"stage\": \"" << funnel[i] << "\", \"count\": " <<
+               (it == counts.end() ? 0 : it->second) << "}";
+    }
+    out << "\n  ]\n}\n";
+    return out.good();
+}
+
+ScopedTimer::ScopedTimer(const char *s)
+{
+    stage = s;
+    start = cv::getTickCount();
+    running = true;
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    stop();
+}
+
+void ScopedTimer::stop()
+{
+    if (running) {
+        PipelineStats::instance().addTime(stage,
+            (cv::getTickCount() - start) * 1000.0 / cv::getTickFrequency());
+        running = false;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PipelineStats_hpp
+#define PipelineStats_hpp
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Process wide registry of stage timings and candidate counts, safe to
+// update from worker threads. Disabled (and nearly free) by default.
+class PipelineStats
+{
+public:
+    static PipelineStats &instance();
+    void addTime(const std::string &stage, double ms);
+    void addCount(const std::string &counter, long n);
+    bool writeJson(const std::string &path);
+    void reset();
+
+    bool enabled;
+    // counters reported, in order, as the rejection funnel
+    std::vector<std::string> funnel;
+
+private:
+    PipelineStats();
+    struct StageTime
+    {
+        long calls;
+        double total_ms;
+        double max_ms;
+    };
+    std::mutex mutex;
+    std::map<std::string, StageTime> times;
+    std::map<std::string, long> counts;
+};
+
+// adds the lifetime of the object (or the time until stop()) to a stage
+class ScopedTimer
+{
+public:
+    ScopedTimer(const char *s);
+    ~ScopedTimer();
+    void stop();
+
+private:
+    const char *stage;
+    int64 start;
+    bool running;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "plate.hpp"
 
+#include <algorithm>
+
 Plate::Plate() 
 {
 }
@@ -10,41 +12,44 @@ Plate::Plate(cv::Mat img, cv::Rect pos)
     position = pos;
 }
 
-std::string Plate::str() 
+void Plate::charOrder(std::vector<int> &order) const
 {
-    /* concat strings with the x coordinate value of chars*/
-    std::string result = "";
-    std::vector<int> order_index;
-    std::vector<int> x_positions;
-    for (int i = 0; i < chars_pos.size(); i++) {
-        order_index.push_back(i);
-        x_positions.push_back(chars_pos[i].x);
+    /* reading order of chars: rows from top to bottom, then left to right */
+    int n = (int)chars_pos.size();
+    order.resize(n);
+    for (int i = 0; i < n; i++) {
+        order[i] = i;
     }
+    const std::vector<cv::Rect> &pos = chars_pos;
+    // twice the vertical center, keeps everything in integers
+    auto center_y = [&pos](int i) { return 2*pos[i].y + pos[i].height; };
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return center_y(a) < center_y(b);
+    });
 
-    float min  = x_positions[0];
-    int min_idx = 0;
-    for (int i = 0; i < x_positions.size(); i++) {
-        min = x_positions[i];
-        min_idx = i;
-        for (int j = 0; j < x_positions.size(); j++) {
-            if (x_positions[j] < min) {
-                min = x_positions[j];
-                min_idx = j;
-            }
+    // a new row starts where the centers jump by more than half a char
+    int begin = 0;
+    for (int i = 1; i <= n; i++) {
+        if (i == n || center_y(order[i]) - center_y(order[i-1]) >
+                      std::max(pos[order[i]].height, pos[order[i-1]].height)) {
+            std::sort(order.begin() + begin, order.begin() + i, [&pos](int a, int b) {
+                return pos[a].x < pos[b].x || (pos[a].x == pos[b].x && a < b);
+            });
+            begin = i;
         }
-        int aux_i = order_index[i];
-        int aux_min = order_index[min_idx];
-        order_index[i] = aux_min;
-        order_index[min_idx] = aux_i;
-
-        float aux_ai = x_positions[i];
-        float aux_xmin = x_positions[min_idx];
-        x_positions[i] = aux_xmin;
-        x_positions[min_idx] = aux_i;
     }
+}
+
+std::string Plate::str() const
+{
+    /* concat chars in reading order */
+    std::vector<int> order;
+    charOrder(order);
 
-    for (int i = 0; i < order_index.size(); i++) {
-        result = result+chars[order_index[i]];
+    std::string result;
+    result.reserve(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        result += chars[order[i]];
     }
 
     return result;
@@ -11,7 +11,8 @@ class Plate
 public:
     Plate();
     Plate(cv::Mat img, cv::Rect pos);
-    std::string str();
+    std::string str() const;
+    void charOrder(std::vector<int> &order) const;
     cv::Rect position;
     cv::Mat plate_img;
     std::vector<char> chars;
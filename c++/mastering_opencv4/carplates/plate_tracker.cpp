@@ -0,0 +1,153 @@
+#include "plate_tracker.hpp"
+
+#include <algorithm>
+
+TrackedPlate::TrackedPlate()
+{
+    id = -1;
+    last_frame = 0;
+    missed = 0;
+    emitted = false;
+}
+
+TrackedPlate::TrackedPlate(int i, cv::Rect2f b, int frame)
+{
+    id = i;
+    box = b;
+    last_frame = frame;
+    missed = 0;
+    emitted = false;
+}
+
+std::string TrackedPlate::best(int *num_votes) const
+{
+    std::string result;
+    int max_votes = 0;
+    std::map<std::string, int>::const_iterator it = votes.begin();
+    for (; it != votes.end(); ++it) {
+        if (it->second > max_votes) {
+            max_votes = it->second;
+            result = it->first;
+        }
+    }
+    if (num_votes) {
+        *num_votes = max_votes;
+    }
+    return result;
+}
+
+PlateTracker::PlateTracker()
+{
+    min_iou = 0.2;
+    max_missed = 2;
+    min_votes = 3;
+    dedup_frames = 150;
+    next_id = 0;
+    frame = 0;
+}
+
+static float iou(const cv::Rect2f &a, const cv::Rect2f &b)
+{
+    float inter = (a & b).area();
+    float uni = a.area() + b.area() - inter;
+    return (uni > 0) ? inter / uni : 0;
+}
+
+void PlateTracker::predict()
+{
+    // called once per frame, before update() on detection frames;
+    // constant velocity motion between detections
+    frame++;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        tracks[i].box.x += tracks[i].velocity.x;
+        tracks[i].box.y += tracks[i].velocity.y;
+    }
+}
+
+void PlateTracker::update(const std::vector<Plate> &detections)
+{
+    std::vector<bool> matched(tracks.size(), false);
+    for (size_t d = 0; d < detections.size(); d++) {
+        cv::Rect2f box(detections[d].position);
+        int best = -1;
+        float best_iou = min_iou;
+        for (size_t t = 0; t < tracks.size(); t++) {
+            float o = iou(tracks[t].box, box);
+            if (!matched[t] && o > best_iou) {
+                best_iou = o;
+                best = (int)t;
+            }
+        }
+        if (best < 0) {
+            tracks.push_back(TrackedPlate(next_id++, box, frame));
+            matched.push_back(true);
+            best = (int)tracks.size() - 1;
+        } else {
+            TrackedPlate &track = tracks[best];
+            int dt = std::max(1, frame - track.last_frame);
+            // the prediction already moved the box, measure from the last detection
+            cv::Point2f predicted_tl = track.box.tl() - track.velocity*(float)dt;
+            track.velocity = (box.tl() - predicted_tl) * (1.0f/dt);
+            track.box = box;
+            track.last_frame = frame;
+            track.missed = 0;
+            matched[best] = true;
+        }
+        if (!detections[d].chars.empty()) {
+            tracks[best].votes[detections[d].str()]++;
+        }
+    }
+    for (size_t t = 0; t < tracks.size(); t++) {
+        if (!matched[t]) {
+            tracks[t].missed++;
+        }
+    }
+}
+
+bool PlateTracker::emit(TrackedPlate &track, std::vector<std::string> &out)
+{
+    int num_votes;
+    std::string s = track.best(&num_votes);
+    if (track.emitted || num_votes < min_votes) {
+        return false;
+    }
+    track.emitted = true;
+    std::map<std::string, int>::iterator it = emitted_at.find(s);
+    if (it != emitted_at.end() && frame - it->second < dedup_frames) {
+        return false;
+    }
+    emitted_at[s] = frame;
+    out.push_back(s);
+    return true;
+}
+
+std::vector<std::string> PlateTracker::confirmed()
+{
+    // plates with enough agreeing readings, each reported once, and
+    // tracks that left the scene are dropped
+    std::vector<std::string> out;
+    std::vector<TrackedPlate>::iterator it = tracks.begin();
+    while (it != tracks.end()) {
+        emit(*it, out);
+        if (it->missed > max_missed) {
+            it = tracks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return out;
+}
+
+std::vector<std::string> PlateTracker::flush()
+{
+    // end of stream: report whatever has at least one reading
+    int votes = min_votes;
+    min_votes = 1;
+    std::vector<std::string> out;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        emit(tracks[i], out);
+    }
+    min_votes = votes;
+    tracks.clear();
+    return out;
+}
@@ -0,0 +1,50 @@
+#ifndef PlateTracker_hpp
+#define PlateTracker_hpp
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "plate.hpp"
+
+#include <opencv2/core.hpp>
+
+class TrackedPlate
+{
+public:
+    TrackedPlate();
+    TrackedPlate(int i, cv::Rect2f b, int frame);
+    std::string best(int *num_votes = NULL) const;
+
+    int id;
+    cv::Rect2f box;
+    cv::Point2f velocity;   // pixels per frame
+    int last_frame;         // frame of the last matched detection
+    int missed;             // detection rounds without a match
+    bool emitted;
+    std::map<std::string, int> votes;
+};
+
+class PlateTracker
+{
+public:
+    PlateTracker();
+    void predict();
+    void update(const std::vector<Plate> &detections);
+    std::vector<std::string> confirmed();
+    std::vector<std::string> flush();
+
+    std::vector<TrackedPlate> tracks;
+    float min_iou;          // match threshold between prediction and detection
+    int max_missed;         // detection rounds a track survives unmatched
+    int min_votes;          // readings needed before a plate is emitted
+    int dedup_frames;       // a string is emitted at most once in this window
+
+private:
+    bool emit(TrackedPlate &track, std::vector<std::string> &out);
+    int next_id;
+    int frame;
+    std::map<std::string, int> emitted_at;
+};
+
+#endif
@@ -0,0 +1,94 @@
+#include "plate_verifier.hpp"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "pipeline_stats.hpp"
+
+const int PlateVerifier::image_width = 144;
+const int PlateVerifier::image_height = 33;
+
+PlateVerifier::PlateVerifier()
+{
+    use_hog = true;
+    // 144x32 window, 16x16 blocks without overlap and 8x8 cells:
+    // 9x2 blocks of 4 cells with 9 bins, 648 values instead of 4752 pixels
+    hog = cv::HOGDescriptor(cv::Size(144, 32), cv::Size(16, 16), cv::Size(16, 16),
+                            cv::Size(8, 8), 9);
+}
+
+cv::Mat PlateVerifier::features(const std::vector<cv::Mat> &images)
+{
+    int n = (int)images.size();
+    cv::Mat out;
+    if (!use_hog) {
+        out.create(n, image_width*image_height, CV_32FC1);
+        for (int i = 0; i < n; i++) {
+            images[i].reshape(1, 1).convertTo(out.row(i), CV_32FC1);
+        }
+        return out;
+    }
+
+    out.create(n, (int)hog.getDescriptorSize(), CV_32FC1);
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range) {
+        cv::Mat resized;
+        std::vector<float> descriptor;
+        for (int i = range.start; i < range.end; i++) {
+            cv::resize(images[i], resized, hog.winSize, 0, 0, cv::INTER_AREA);
+            hog.compute(resized, descriptor);
+            std::copy(descriptor.begin(), descriptor.end(), out.ptr<float>(i));
+        }
+    });
+    return out;
+}
+
+void PlateVerifier::train(cv::Mat samples, cv::Mat labels)
+{
+    // training sets store raw pixel rows, features are computed here
+    std::vector<cv::Mat> images(samples.rows);
+    for (int i = 0; i < samples.rows; i++) {
+        samples.row(i).reshape(1, image_height).convertTo(images[i], CV_8UC1);
+    }
+    cv::Mat train_samples = features(images);
+
+    svm = cv::ml::SVM::create();
+    svm->setType(cv::ml::SVM::C_SVC);
+    svm->setKernel(cv::ml::SVM::LINEAR);
+    svm->setDegree(0.0);
+    svm->setGamma(1.0);
+    svm->setCoef0(0);
+    svm->setC(1);
+    svm->setNu(0.0);
+    svm->setP(0);
+    svm->setTermCriteria(
+            cv::TermCriteria(cv::TermCriteria::MAX_ITER, 1000, 0.01));
+
+    cv::Ptr<cv::ml::TrainData> train_data = cv::ml::TrainData::create(train_samples,
+                                                      cv::ml::ROW_SAMPLE,
+                                                      labels);
+    svm->train(train_data);
+}
+
+std::vector<Plate> PlateVerifier::verify(const std::vector<Plate> &candidates)
+{
+    // all candidates of an image go through a single predict call
+    ScopedTimer timer("verify");
+    std::vector<Plate> plates;
+    if (candidates.empty()) {
+        return plates;
+    }
+    std::vector<cv::Mat> images(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        images[i] = candidates[i].plate_img;
+    }
+    cv::Mat responses;
+    svm->predict(features(images), responses);
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if ((int)responses.at<float>(i) == 1) {
+            plates.push_back(candidates[i]);
+        }
+    }
+    PipelineStats::instance().addCount("verified", plates.size());
+    return plates;
+}
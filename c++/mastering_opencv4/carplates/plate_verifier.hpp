@@ -0,0 +1,30 @@
+#ifndef PlateVerifier_hpp
+#define PlateVerifier_hpp
+
+#include <vector>
+
+#include "plate.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/ml.hpp>
+#include <opencv2/objdetect.hpp>
+
+class PlateVerifier
+{
+public:
+    PlateVerifier();
+    void train(cv::Mat samples, cv::Mat labels);
+    std::vector<Plate> verify(const std::vector<Plate> &candidates);
+    cv::Mat features(const std::vector<cv::Mat> &images);
+
+    // HOG descriptor of the candidate, raw pixels when false
+    bool use_hog;
+    static const int image_width;
+    static const int image_height;
+
+private:
+    cv::HOGDescriptor hog;
+    cv::Ptr<cv::ml::SVM> svm;
+};
+
+#endif
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 
+#include "svm_dataset.hpp"
+
 #include <opencv2/opencv.hpp>
 
 int main (int argc, char **argv) {
@@ -9,6 +11,7 @@ int main (int argc, char **argv) {
     char *notplate_path;
     int num_plates;
     int num_notplates;
+    std::string output = "svm.bin";
     const int image_width = 144;
     const int image_height = 33;
 
@@ -17,51 +20,64 @@ int main (int argc, char **argv) {
         num_notplates = atoi(argv[2]);
         plate_path = argv[3];
         notplate_path = argv[4];
+        if (argc >= 6) {
+            output = argv[5];
+        }
     } else {
         std::cout << "Usage: \n" << argv[0] << 
         " <num plates > <num non plates> <path to plate files> " <<
-        " <path to not plate files>" << std::endl;
+        " <path to not plate files> [output, svm.bin or *.xml]" << std::endl;
+        return 0;
     }
 
-    cv::Mat classes;
-    cv::Mat training_data;
-    cv::Mat training_images;
-    std::vector<int> training_labels;
+    // every sample gets its own row, so images are decoded in parallel
+    // straight into the final float matrix
+    int num_samples = num_plates + num_notplates;
+    cv::Mat training_data(num_samples, image_width*image_height, CV_32FC1);
+    cv::Mat classes(num_samples, 1, CV_32SC1);
+    std::vector<uchar> valid(num_samples, 0);
 
-    for (int i = 0; i < num_plates; i++) {
-        std::stringstream ss(std::stringstream::in | std::stringstream::out);
-        ss << plate_path << i << ".jpg";
-        cv::Mat img = cv::imread(ss.str(), 0);
-        if (img.empty()) {
-            std::cout << "Failed to read image from" << ss.str() << std::endl;
+    cv::parallel_for_(cv::Range(0, num_samples), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            bool is_plate = i < num_plates;
+            std::stringstream ss(std::stringstream::in | std::stringstream::out);
+            ss << (is_plate ? plate_path : notplate_path) <<
+                  (is_plate ? i : i - num_plates) << ".jpg";
+            cv::Mat img = cv::imread(ss.str(), 0);
+            if (img.empty() || img.cols != image_width || img.rows != image_height) {
+                std::cout << "Failed to read image from " << ss.str() << std::endl;
+                continue;
+            }
+            img.reshape(1, 1).convertTo(training_data.row(i), CV_32FC1);
+            classes.at<int>(i) = is_plate ? 1 : 0;
+            valid[i] = 1;
         }
-        img = img.reshape(1, 1);
-        training_images.push_back(img);
-        training_labels.push_back(1);
-    }
+    });
 
-    for (int i = 0; i < num_notplates; i++) {
-        std::stringstream ss(std::stringstream::in | std::stringstream::out);
-        ss << notplate_path << i << ".jpg";
-        cv::Mat img = cv::imread(ss.str(), 0);
-        if (img.empty()) {
-            std::cout << "Failed to read image from" << ss.str() << std::endl;
+    // drop the samples that failed to load
+    int num_valid = 0;
+    for (int i = 0; i < num_samples; i++) {
+        if (valid[i]) {
+            if (num_valid != i) {
+                training_data.row(i).copyTo(training_data.row(num_valid));
+                classes.at<int>(num_valid) = classes.at<int>(i);
+            }
+            num_valid++;
         }
-        img = img.reshape(1, 1);
-        training_images.push_back(img);
-        training_labels.push_back(0);
     }
+    training_data = training_data.rowRange(0, num_valid);
+    classes = classes.rowRange(0, num_valid);
+    std::cout << "Loaded " << num_valid << " of " << num_samples << " samples" << std::endl;
 
-    cv::Mat(training_images).copyTo(training_data); 
-    training_data.convertTo(training_data, CV_32FC1);
-    cv::Mat(training_labels).copyTo(classes);
-
-    cv::FileStorage fs("svm.xml", cv::FileStorage::WRITE);
-    fs << "training_data" << training_data;
-    fs << "training_labels" << classes;
-    fs.release();
+    if (output.size() > 4 && output.compare(output.size()-4, 4, ".xml") == 0) {
+        cv::FileStorage fs(output, cv::FileStorage::WRITE);
+        fs << "training_data" << training_data;
+        fs << "training_labels" << classes;
+        fs.release();
+    } else if (!SvmDataset::write(output, training_data, classes)) {
+        std::cout << "Failed to write " << output << std::endl;
+        return 1;
+    }
 
     return 0;
 }
-
-
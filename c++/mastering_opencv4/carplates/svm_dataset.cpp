@@ -0,0 +1,98 @@
+#include "svm_dataset.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[8] = {'A', 'N', 'P', 'R', 'S', 'V', 'M', '1'};
+static const size_t header_size = sizeof(magic) + 2*sizeof(int32_t);
+
+SvmDataset::SvmDataset()
+{
+    map = NULL;
+    map_size = 0;
+}
+
+SvmDataset::~SvmDataset()
+{
+    close();
+}
+
+bool SvmDataset::open(std::string path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < header_size) {
+        ::close(fd);
+        return false;
+    }
+    // private mapping, cv::Mat users may write without touching the file
+    void *m = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+    map = m;
+    map_size = st.st_size;
+
+    const char *p = (const char *)map;
+    int32_t rows, cols;
+    std::memcpy(&rows, p + sizeof(magic), sizeof(rows));
+    std::memcpy(&cols, p + sizeof(magic) + sizeof(rows), sizeof(cols));
+    size_t expected = header_size + (size_t)rows*cols*sizeof(float) +
+                      (size_t)rows*sizeof(int32_t);
+    if (std::memcmp(p, magic, sizeof(magic)) != 0 || rows <= 0 || cols <= 0 ||
+        expected != map_size) {
+        std::cout << "Invalid SVM dataset: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    char *base = (char *)map;
+    data = cv::Mat(rows, cols, CV_32FC1, base + header_size);
+    labels = cv::Mat(rows, 1, CV_32SC1, base + header_size + (size_t)rows*cols*sizeof(float));
+    return true;
+}
+
+void SvmDataset::close()
+{
+    data.release();
+    labels.release();
+    if (map) {
+        munmap(map, map_size);
+        map = NULL;
+        map_size = 0;
+    }
+}
+
+bool SvmDataset::write(std::string path, const cv::Mat &data, const cv::Mat &labels)
+{
+    CV_Assert(data.type() == CV_32FC1 && labels.type() == CV_32SC1);
+    CV_Assert(labels.total() == (size_t)data.rows);
+
+    std::ofstream out(path.c_str(), std::ios::binary);
+    if (!out) {
+        return false;
+    }
+    int32_t rows = data.rows;
+    int32_t cols = data.cols;
+    out.write(magic, sizeof(magic));
+    out.write((const char *)&rows, sizeof(rows));
+    out.write((const char *)&cols, sizeof(cols));
+    for (int i = 0; i < data.rows; i++) {
+        out.write((const char *)data.ptr<float>(i), cols*sizeof(float));
+    }
+    cv::Mat l = labels.isContinuous() ? labels : labels.clone();
+    out.write((const char *)l.ptr<int32_t>(), rows*sizeof(int32_t));
+    return out.good();
+}
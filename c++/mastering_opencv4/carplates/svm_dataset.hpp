@@ -0,0 +1,32 @@
+#ifndef SvmDataset_hpp
+#define SvmDataset_hpp
+
+#include <string>
+
+#include <opencv2/core.hpp>
+
+// Binary SVM training set, written once by prepare_svm_data and mapped
+// read-only by the trainer. Layout (native endianness):
+//   char[8] magic "ANPRSVM1", int32 rows, int32 cols,
+//   rows*cols float32 samples (row major), rows int32 labels
+class SvmDataset
+{
+public:
+    SvmDataset();
+    ~SvmDataset();
+    bool open(std::string path);
+    void close();
+    static bool write(std::string path, const cv::Mat &data, const cv::Mat &labels);
+
+    // headers over the mapped file, valid until close()
+    cv::Mat data;
+    cv::Mat labels;
+
+private:
+    SvmDataset(const SvmDataset &);
+    SvmDataset &operator=(const SvmDataset &);
+    void *map;
+    size_t map_size;
+};
+
+#endif
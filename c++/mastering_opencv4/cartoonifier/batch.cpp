@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "batch.hpp"
+#include "cartoon.hpp"
+
+// Frames handed between the reader, the workers and the writer. At most maxInFlight
+// frames are decoded but not yet written, which bounds the memory use when the
+// encoder or the filters are slower than the decoder.
+struct FrameQueue {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<std::pair<int, cv::Mat> > decoded;
+    std::map<int, cv::Mat> cartoonified;
+    int inFlight = 0;
+    int maxInFlight = 0;
+    int numFrames = -1;     // known once the reader reached the end of the stream
+};
+
+static void readFrames(cv::VideoCapture &video, FrameQueue &queue)
+{
+    for (auto index = 0; ; index++) {
+        cv::Mat frame;
+        if (!video.read(frame) || frame.empty()) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.numFrames = index;
+            break;
+        }
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.cond.wait(lock, [&] { return queue.inFlight < queue.maxInFlight; });
+        queue.decoded.push_back(std::make_pair(index, frame));
+        queue.inFlight++;
+        lock.unlock();
+        queue.cond.notify_all();
+    }
+    queue.cond.notify_all();
+}
+
+static void cartoonifyFrames(FrameQueue &queue, bool sketchMode, int paintMode)
+{
+    while (true) {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.cond.wait(lock, [&] { return !queue.decoded.empty() || queue.numFrames >= 0; });
+        if (queue.decoded.empty())
+            return;
+        std::pair<int, cv::Mat> frame = queue.decoded.front();
+        queue.decoded.pop_front();
+        lock.unlock();
+
+        // Frames are not processed in order, so there is no skin cache to carry over.
+        cv::Mat cartoon = cv::Mat(frame.second.size(), CV_8UC3);
+        cartoonifyImage(frame.second, cartoon, sketchMode, false, false, 0, paintMode);
+
+        lock.lock();
+        queue.cartoonified[frame.first] = cartoon;
+        lock.unlock();
+        queue.cond.notify_all();
+    }
+}
+
+static void writeFrames(cv::VideoWriter &writer, FrameQueue &queue)
+{
+    for (auto index = 0; ; index++) {
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.cond.wait(lock, [&] { return queue.cartoonified.count(index) || queue.numFrames == index; });
+        if (queue.numFrames == index)
+            return;
+        cv::Mat cartoon = queue.cartoonified[index];
+        queue.cartoonified.erase(index);
+        queue.inFlight--;
+        lock.unlock();
+        queue.cond.notify_all();
+
+        writer.write(cartoon);
+    }
+}
+
+int cartoonifyVideo(const char *inputFile, const char *outputFile, int numWorkers, bool sketchMode, int paintMode)
+{
+    cv::VideoCapture video(inputFile);
+    if (!video.isOpened()) {
+        std::cerr << "ERROR: could not open " << inputFile << std::endl;
+        return EXIT_FAILURE;
+    }
+    double fps = video.get(cv::CAP_PROP_FPS);
+    if (fps <= 0)
+        fps = 30;
+    cv::Size size((int)video.get(cv::CAP_PROP_FRAME_WIDTH), (int)video.get(cv::CAP_PROP_FRAME_HEIGHT));
+
+    // MJPG is available in every OpenCV build for .avi, otherwise let the extension decide.
+    std::string output = outputFile;
+    int fourcc = cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    if (output.size() > 4 && output.substr(output.size() - 4) == ".avi")
+        fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+    cv::VideoWriter writer(output, fourcc, fps, size);
+    if (!writer.isOpened()) {
+        std::cerr << "ERROR: could not write " << outputFile << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (numWorkers <= 0)
+        numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    FrameQueue queue;
+    queue.maxInFlight = 2 * numWorkers;
+
+    int64 t = cv::getTickCount();
+    std::thread reader(readFrames, std::ref(video), std::ref(queue));
+    std::thread writerThread(writeFrames, std::ref(writer), std::ref(queue));
+    std::vector<std::thread> workers;
+    for (auto i = 0; i < numWorkers; i++)
+        workers.push_back(std::thread(cartoonifyFrames, std::ref(queue), sketchMode, paintMode));
+    reader.join();
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    writerThread.join();
+    writer.release();
+
+    double seconds = (cv::getTickCount() - t) / cv::getTickFrequency();
+    double outputFps = queue.numFrames / seconds;
+    std::cout << "Cartoonified " << queue.numFrames << " frames with " << numWorkers << " workers in "
+              << seconds << " s: " << outputFps << " FPS, " << outputFps / fps << "x real time" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+// Headless file to file cartoonifier: decodes the input video on a reader thread,
+// cartoonifies frames on numWorkers threads in parallel (0 picks one per core) and
+// encodes them in their original order on a writer thread.
+// Returns EXIT_SUCCESS, or EXIT_FAILURE if the input or output can not be opened.
+int cartoonifyVideo(const char *inputFile, const char *outputFile, int numWorkers, bool sketchMode, int paintMode);
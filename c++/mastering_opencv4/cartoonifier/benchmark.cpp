@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <opencv2/opencv.hpp>
+#include "cartoon.hpp"
+
+// Compares the paint modes of cartoonifyImage() on an image or video:
+// time per frame and PSNR against the original bilateral output,
+// with and without tiled multi-threaded execution.
+// Exits with 1 if the domain transform paint stage is not faster than the
+// bilateral one, if it is no closer to the bilateral output than leaving the
+// image unpainted, or if a tiled run differs from the whole frame run in any pixel.
+//
+// usage: cartoon_benchmark input [width height] [frames]
+
+const int DEFAULT_WIDTH = 1280;
+const int DEFAULT_HEIGHT = 720;
+const int DEFAULT_FRAMES = 30;
+const char *paintModeNames[NUM_PAINT_MODES] = {"bilateral", "domain transform"};
+// Lowest mean PSNR of the domain transform paint stage against the bilateral one.
+// Measured 36.8 dB (35.2 dB on the worst frame) over the carplates test stills at
+// 1280x720, the unpainted image was 33.9 dB; 1.8 dB is left for other footage.
+const double MIN_PAINT_PSNR = 35.0;
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "usage: " << argv[0] << " input [width height] [frames]" << std::endl;
+        return 1;
+    }
+    int width = DEFAULT_WIDTH;
+    int height = DEFAULT_HEIGHT;
+    int numFrames = DEFAULT_FRAMES;
+    if (argc > 3) {
+        width = atoi(argv[2]);
+        height = atoi(argv[3]);
+    }
+    if (argc > 4) {
+        numFrames = atoi(argv[4]);
+    }
+
+    // Load the frames up front so decoding is not part of the timing.
+    std::vector<cv::Mat> frames;
+    cv::Mat image = cv::imread(argv[1]);
+    if (!image.empty()) {
+        frames.push_back(image);
+    } else {
+        cv::VideoCapture video(argv[1]);
+        cv::Mat frame;
+        while ((int)frames.size() < numFrames && video.read(frame)) {
+            frames.push_back(frame.clone());
+        }
+    }
+    if (frames.empty()) {
+        std::cerr << "ERROR: could not read " << argv[1] << std::endl;
+        return 1;
+    }
+    for (size_t i = 0; i < frames.size(); i++) {
+        cv::resize(frames[i], frames[i], cv::Size(width, height));
+    }
+
+    // The optimized despeckle has to match the scalar reference bit for bit,
+    // on the same edge masks cartoonifyImage() produces.
+    double fastMs = 0;
+    double referenceMs = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        cv::Mat gray, edges, mask;
+        cv::cvtColor(frames[i], gray, cv::COLOR_BGR2GRAY);
+        cv::medianBlur(gray, gray, 7);
+        cv::Laplacian(gray, edges, CV_8U, 5);
+        cv::threshold(edges, mask, 80, 255, cv::THRESH_BINARY_INV);
+        cv::Mat fast = mask.clone();
+        cv::Mat reference = mask.clone();
+        int64 t = cv::getTickCount();
+        removePepperNoise(fast);
+        fastMs += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        t = cv::getTickCount();
+        removePepperNoiseReference(reference);
+        referenceMs += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        if (cv::countNonZero(fast != reference) > 0) {
+            std::cerr << "ERROR: removePepperNoise() differs from the reference on frame " << i << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "removePepperNoise: " << fastMs / frames.size() << " ms/frame, reference "
+              << referenceMs / frames.size() << " ms/frame, bit exact" << std::endl;
+
+    // The paint stage alone, on the half size image cartoonifyImage() paints. The
+    // PSNR floor for the domain transform is measured on the same frame: the PSNR
+    // of the unpainted image against the bilateral output, so the replacement has
+    // to be a better approximation of the bilateral look than no smoothing at all.
+    double paintMs[NUM_PAINT_MODES] = {0, 0};
+    double totalPaintPsnr = 0;
+    double totalFloorPsnr = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        cv::Mat smallImg;
+        cv::resize(frames[i], smallImg, cv::Size(frames[i].cols/2, frames[i].rows/2), 0, 0, cv::INTER_LINEAR);
+        cv::Mat painted[NUM_PAINT_MODES];
+        for (auto mode = 0; mode < NUM_PAINT_MODES; mode++) {
+            painted[mode] = smallImg.clone();
+            int64 t = cv::getTickCount();
+            paintImage(painted[mode], mode);
+            paintMs[mode] += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+        }
+        double psnr = cv::PSNR(painted[PAINT_BILATERAL], painted[PAINT_DOMAIN_TRANSFORM]);
+        double floorPsnr = cv::PSNR(painted[PAINT_BILATERAL], smallImg);
+        totalPaintPsnr += psnr;
+        totalFloorPsnr += floorPsnr;
+        if (psnr <= floorPsnr) {
+            std::cerr << "ERROR: domain transform is " << psnr << " dB from bilateral on frame " << i
+                      << ", the unpainted image " << floorPsnr << " dB" << std::endl;
+            return 1;
+        }
+    }
+    for (auto mode = 0; mode < NUM_PAINT_MODES; mode++) {
+        std::cout << paintModeNames[mode] << " paint stage at " << width/2 << "x" << height/2 << ": "
+                  << paintMs[mode] / frames.size() << " ms/frame" << std::endl;
+    }
+    std::cout << "domain transform PSNR vs bilateral " << totalPaintPsnr / frames.size()
+              << " dB, unpainted " << totalFloorPsnr / frames.size() << " dB" << std::endl;
+    if (totalPaintPsnr / frames.size() < MIN_PAINT_PSNR) {
+        std::cerr << "ERROR: domain transform is below " << MIN_PAINT_PSNR << " dB PSNR vs bilateral" << std::endl;
+        return 1;
+    }
+    if (paintMs[PAINT_DOMAIN_TRANSFORM] >= paintMs[PAINT_BILATERAL]) {
+        std::cerr << "ERROR: the domain transform paint stage is not faster than bilateral" << std::endl;
+        return 1;
+    }
+
+    // Each paint mode is timed on the whole frame and split into parallel bands;
+    // the halos cover every filter radius, so the tiled output has to match the
+    // whole frame output bit for bit.
+    std::vector<cv::Mat> reference(frames.size());
+    std::vector<cv::Mat> wholeFrame(frames.size());
+    for (auto mode = 0; mode < NUM_PAINT_MODES; mode++) {
+        for (auto tiled = 0; tiled < 2; tiled++) {
+            double totalMs = 0;
+            double totalPsnr = 0;
+            double minPsnr = 1e9;
+            double totalTilePsnr = 0;
+            for (auto i = 0; i < numFrames; i++) {
+                size_t f = i % frames.size();
+                cv::Mat src = frames[f].clone();   // cartoonifyImage() writes into its input
+                cv::Mat dst = cv::Mat(src.size(), CV_8UC3);
+                int64 t = cv::getTickCount();
+                cartoonifyImage(src, dst, false, false, false, 0, mode, tiled != 0);
+                totalMs += (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+                if (!tiled) {
+                    wholeFrame[f] = dst;
+                    if (mode == PAINT_BILATERAL) {
+                        reference[f] = dst;
+                    }
+                } else {
+                    totalTilePsnr += cv::PSNR(wholeFrame[f], dst);
+                    if (cv::norm(wholeFrame[f], dst, cv::NORM_INF) > 0) {
+                        std::cerr << "ERROR: tiled " << paintModeNames[mode]
+                                  << " differs from the whole frame on frame " << f << std::endl;
+                        return 1;
+                    }
+                }
+                if (mode != PAINT_BILATERAL) {
+                    double psnr = cv::PSNR(reference[f], dst);
+                    totalPsnr += psnr;
+                    minPsnr = std::min(minPsnr, psnr);
+                }
+            }
+            double ms = totalMs / numFrames;
+            std::cout << paintModeNames[mode] << (tiled ? " (tiled)" : "") << ": "
+                      << ms << " ms/frame, " << 1000.0 / ms << " FPS";
+            if (mode != PAINT_BILATERAL) {
+                std::cout << ", PSNR vs bilateral " << totalPsnr / numFrames << " dB (min " << minPsnr << " dB)";
+            }
+            if (tiled) {
+                std::cout << ", PSNR vs whole frame " << totalTilePsnr / numFrames << " dB";
+            }
+            std::cout << std::endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -1,23 +1,95 @@
 #include "cartoon.hpp"
+#include <opencv2/core/hal/intrin.hpp>
 
-void cartoonifyImage(cv::Mat srcColor, cv::Mat dst, bool sketchMode, bool alienMode, bool evilMode, int debugType) 
+// Runs op on horizontal bands of src in parallel and stitches the band results into dst.
+// Each band is given "halo" extra rows above and below (clamped at the image borders), so
+// as long as halo covers the radius of the filters inside op, the stitched output is the
+// same as running op once on the whole image. op must create its output at the input size.
+static void processBands(const cv::Mat &src, cv::Mat &dst, int halo, bool tiled,
+                         const std::function<void(const cv::Mat&, cv::Mat&)> &op)
+{
+    // Keep bands a few halos tall, otherwise the overlap costs more than the threads save.
+    int numBands = std::min(cv::getNumThreads(), src.rows / std::max(4 * halo, 16));
+    if (!tiled || numBands < 2) {
+        op(src, dst);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, numBands), [&](const cv::Range &range) {
+        for (auto b = range.start; b < range.end; b++) {
+            int y0 = src.rows * b / numBands;
+            int y1 = src.rows * (b + 1) / numBands;
+            int top = std::max(0, y0 - halo);
+            int bottom = std::min(src.rows, y1 + halo);
+            // Clone the band so the filters extrapolate at its edges instead of reading
+            // neighbouring rows through the ROI; those rows are in the discarded halo anyway.
+            cv::Mat band = src.rowRange(top, bottom).clone();
+            cv::Mat out;
+            op(band, out);
+            out.rowRange(y0 - top, y1 - top).copyTo(dst.rowRange(y0, y1));
+        }
+    });
+}
+
+void paintImage(cv::Mat smallImg, int paintMode, bool tiled)
+{
+    if(paintMode == PAINT_DOMAIN_TRANSFORM) {
+        // A single edge-preserving pass instead of 14 bilateral filters.
+        // sigmaS is the spatial extent in pixels, sigmaR the color range (0..1).
+        // Both follow the bilateral stage below: 14 passes of spatial sigma 7 add
+        // up to a sigma of 7*sqrt(14) = 26 pixels, and the color sigma of 9 levels
+        // is widened the same way, 9*sqrt(14)/255 = 0.13.
+        // The recursive filter has unbounded support, so it is never split into bands.
+        float sigmaS = 26;
+        float sigmaR = 0.13f;
+        cv::Mat tmp;
+        cv::edgePreservingFilter(smallImg, tmp, cv::RECURS_FILTER, sigmaS, sigmaR);
+        tmp.copyTo(smallImg);
+        return;
+    }
+
+    cv::Mat tmp = cv::Mat(smallImg.size(), CV_8UC3);
+    int repetitions = 7;
+    int filterSize = 9;
+    double sigmaColor = 9;
+    double sigmaSpace = 7;
+    auto bilateral = [&](const cv::Mat &in, cv::Mat &out) {
+        cv::bilateralFilter(in, out, filterSize, sigmaColor, sigmaSpace);
+    };
+    // Every pass is its own tiled stage with a halo of the filter radius, rather than one
+    // stage for all 14 passes, which would need a 14x larger halo around each band.
+    for(int i = 0; i < repetitions; i++) {
+        processBands(smallImg, tmp, filterSize/2, tiled, bilateral);
+        processBands(tmp, smallImg, filterSize/2, tiled, bilateral);
+    }
+}
+
+void cartoonifyImage(cv::Mat srcColor, cv::Mat dst, bool sketchMode, bool alienMode, bool evilMode, int debugType, int paintMode, bool tiled, SkinCache *skinCache) 
 {
-    cv::Mat srcGray;
-    cv::cvtColor(srcColor, srcGray, cv::COLOR_BGR2GRAY);
-    cv::medianBlur(srcGray, srcGray, 7);
     cv::Size size = srcColor.size();
     cv::Mat mask = cv::Mat(size, CV_8U);
     cv::Mat edges = cv::Mat(size, CV_8U);
+    // Grayscale, median blur and edge filter run as one tiled stage,
+    // so the halo is the sum of the median and edge filter radii.
+    const int medianSize = 7;
+    const int edgeHalo = medianSize/2 + (evilMode ? 1 : 5/2);
+    processBands(srcColor, edges, edgeHalo, tiled, [&](const cv::Mat &src, cv::Mat &out) {
+        cv::Mat srcGray;
+        cv::cvtColor(src, srcGray, cv::COLOR_BGR2GRAY);
+        cv::medianBlur(srcGray, srcGray, medianSize);
+        if(!evilMode) {
+            cv::Laplacian(srcGray, out, CV_8U, 5);
+        } else {
+            cv::Mat edges2;
+            cv::Scharr(srcGray, out, CV_8U, 1, 0);
+            cv::Scharr(srcGray, edges2, CV_8U, 1, 0, -1);
+            out += edges2;
+        }
+    });
     if(!evilMode) {
-        cv::Laplacian(srcGray, edges, CV_8U, 5);
         // cv::imshow("Laplacian", edges);
         cv::threshold(edges, mask, 80, 255, cv::THRESH_BINARY_INV);
         removePepperNoise(mask);
     } else {
-        cv::Mat edges2;
-        cv::Scharr(srcGray, edges, CV_8U, 1, 0);
-        cv::Scharr(srcGray, edges2, CV_8U, 1, 0, -1);
-        edges += edges2;
         cv::threshold(edges, mask, 12, 255, cv::THRESH_BINARY_INV);
         cv::medianBlur(mask, mask, 3);
     }
@@ -32,141 +104,231 @@ void cartoonifyImage(cv::Mat srcColor, cv::Mat dst, bool sketchMode, bool alienM
     smallSize.height = size.height / 2;
     cv::Mat smallImg = cv::Mat(smallSize, CV_8UC3);
     cv::resize(srcColor, smallImg, smallSize, 0, 0, cv::INTER_LINEAR);
-    
-    cv::Mat tmp = cv::Mat(smallSize, CV_8UC3);
-    int repetitions = 7;
-    for(int i = 0; i < repetitions; i++) {
-        int filterSize = 9;
-        double sigmaColor = 9;
-        double sigmaSpace = 7;
-        cv::bilateralFilter(smallImg, tmp, filterSize, sigmaColor, sigmaSpace);
-        cv::bilateralFilter(tmp, smallImg, filterSize, sigmaColor, sigmaSpace);
-    }
+    paintImage(smallImg, paintMode, tiled);
     if(alienMode) {
-        changeFacialSkinColor(smallImg, edges, debugType);
+        changeFacialSkinColor(smallImg, edges, debugType, skinCache);
     }
     cv::resize(smallImg, srcColor, size, 0, 0, cv::INTER_LINEAR);
     memset((char*)dst.data, 0, dst.step*dst.rows); // in c or c++
     srcColor.copyTo(dst, mask);
 }
 
-void changeFacialSkinColor(cv::Mat smallImgBGR, cv::Mat bigEdges, int debugType)
+// Skin classification of every BGR color quantized to 5 bits per channel, indexed by
+// skinLutIndex(). Built once by converting the bin centers to YCrCb and keeping the
+// colors in the usual skin range of Cr and Cb, excluding very dark pixels.
+static const std::vector<uchar> &skinColorLut()
+{
+    static const std::vector<uchar> lut = [] {
+        cv::Mat bgr = cv::Mat(1, 32*32*32, CV_8UC3);
+        for (auto i = 0; i < 32*32*32; i++) {
+            bgr.at<cv::Vec3b>(0, i) = cv::Vec3b((i >> 10) * 8 + 4, ((i >> 5) & 31) * 8 + 4, (i & 31) * 8 + 4);
+        }
+        cv::Mat ycrcb;
+        cv::cvtColor(bgr, ycrcb, cv::COLOR_BGR2YCrCb);
+        std::vector<uchar> table(32*32*32);
+        for (auto i = 0; i < 32*32*32; i++) {
+            cv::Vec3b p = ycrcb.at<cv::Vec3b>(0, i);
+            bool skin = p[0] >= 40 && p[1] >= 133 && p[1] <= 173 && p[2] >= 77 && p[2] <= 127;
+            table[i] = skin ? 255 : 0;
+        }
+        return table;
+    }();
+    return lut;
+}
+
+static inline int skinLutIndex(const uchar *bgr)
 {
-        cv::Mat yuv = cv::Mat(smallImgBGR.size(), CV_8UC3);
-        cv::cvtColor(smallImgBGR, yuv, cv::COLOR_BGR2YCrCb);
+    return ((bgr[0] >> 3) << 10) | ((bgr[1] >> 3) << 5) | (bgr[2] >> 3);
+}
+
+void changeFacialSkinColor(cv::Mat smallImgBGR, cv::Mat bigEdges, int debugType, SkinCache *cache)
+{
+        SkinCache localCache;
+        if (!cache)
+            cache = &localCache;
 
-        // The floodFill mask has to be 2 pixels wider and 2 pixels taller than the small image.
-        // The edge mask is the full src image size, so we will shrink it to the small size,
-        // storing into the floodFill mask data.
+        // Only search for skin inside the face outline drawn by drawFaceStickFigure(),
+        // at the scale of the small image.
         int sw = smallImgBGR.cols;
         int sh = smallImgBGR.rows;
-        cv::Mat maskPlusBorder = cv::Mat::zeros(sh+2, sw+2, CV_8U);
-        cv::Mat mask = maskPlusBorder(cv::Rect(1,1,sw,sh));  // mask is a ROI in maskPlusBorder.
-        cv::resize(bigEdges, mask, smallImgBGR.size());
-
-        cv::threshold(mask, mask, 80, 255, cv::THRESH_BINARY);
-        cv::dilate(mask, mask, cv::Mat());
-        cv::erode(mask, mask, cv::Mat());
-        // cv::imshow("constraints for floodFill", mask);
-
-        // YCrCb Skin detector and color changer using multiple flood fills into a mask.
-        // Apply flood fill on many points around the face, to cover different shades & colors of the face.
-        // Note that these values are dependent on the face outline, drawn in drawFaceStickFigure().
-        int const NUM_SKIN_POINTS = 6;
-        cv::Point skinPts[NUM_SKIN_POINTS];
-        skinPts[0] = cv::Point(sw/2,          sh/2 - sh/6);
-        skinPts[1] = cv::Point(sw/2 - sw/11,  sh/2 - sh/6);
-        skinPts[2] = cv::Point(sw/2 + sw/11,  sh/2 - sh/6);
-        skinPts[3] = cv::Point(sw/2,          sh/2 + sh/16);
-        skinPts[4] = cv::Point(sw/2 - sw/9,   sh/2 + sh/16);
-        skinPts[5] = cv::Point(sw/2 + sw/9,   sh/2 + sh/16);
-        // Skin might be fairly dark, or slightly less colorful.
-        // Skin might be very bright, or slightly more colorful but not much more blue.
-        const int LOWER_Y = 60;
-        const int UPPER_Y = 80;
-        const int LOWER_Cr = 25;
-        const int UPPER_Cr = 15;
-        const int LOWER_Cb = 20;
-        const int UPPER_Cb = 15;
-        cv::Scalar lowerDiff = cv::Scalar(LOWER_Y, LOWER_Cr, LOWER_Cb);
-        cv::Scalar upperDiff = cv::Scalar(UPPER_Y, UPPER_Cr, UPPER_Cb);
-        // Instead of drawing into the "yuv" image, just draw 1's into the "maskPlusBorder" image, so we can apply it later.
-        // The "maskPlusBorder" is initialized with the edges, because floodFill() will not go across non-zero mask pixels.
-        cv::Mat edgeMask = mask.clone();    // Keep an duplicate copy of the edge mask.
-        for (auto i=0; i<NUM_SKIN_POINTS; i++) {
-            const int flags = 4 | cv::FLOODFILL_FIXED_RANGE | cv::FLOODFILL_MASK_ONLY;
-            cv::floodFill(yuv, maskPlusBorder, skinPts[i], cv::Scalar(), NULL, lowerDiff, upperDiff, flags);
-            if (debugType >= 1)
-                cv::circle(smallImgBGR, skinPts[i], 5, CV_RGB(0, 0, 255), 1, cv::LINE_AA);
+        int faceH = sh/2 * 70/100;
+        int faceW = faceH * 72/100;
+        cv::Rect faceRect = cv::Rect(sw/2 - faceW, sh/2 - faceH, 2*faceW, 2*faceH) & cv::Rect(0, 0, sw, sh);
+        if (faceRect.area() == 0)
+            return;
+        if (cache->faceMask.size() != faceRect.size()) {
+            cache->faceMask = cv::Mat::zeros(faceRect.size(), CV_8U);
+            cv::ellipse(cache->faceMask, cv::Point(sw/2 - faceRect.x, sh/2 - faceRect.y), cv::Size(faceW, faceH),
+                        0, 0, 360, cv::Scalar(255), cv::FILLED);
+            cache->skin.create(faceRect.size(), CV_8U);
+        }
+        cv::Mat face = smallImgBGR(faceRect);
+
+        // Classify every pixel inside the outline with the lookup table.
+        const std::vector<uchar> &lut = skinColorLut();
+        for (auto y = 0; y < face.rows; y++) {
+            const uchar *pFace = face.ptr(y);
+            const uchar *pInside = cache->faceMask.ptr(y);
+            uchar *pSkin = cache->skin.ptr(y);
+            for (auto x = 0; x < face.cols; x++) {
+                pSkin[x] = pInside[x] ? lut[skinLutIndex(pFace + 3*x)] : 0;
+            }
         }
 
-        if (debugType >= 1)
-            cv::imshow("flood mask", mask*120); 
+        // Edges still separate the skin from hair, eyes and lips of a similar color.
+        cv::Mat edges;
+        cv::resize(bigEdges, edges, smallImgBGR.size());
+        cv::Mat faceEdges = edges(faceRect);
+        cv::threshold(faceEdges, faceEdges, 80, 255, cv::THRESH_BINARY);
+        cv::Mat mask;
+        cv::subtract(cache->skin, faceEdges, mask);
 
-        // After the flood fill, "mask" contains both edges and skin pixels, whereas
-        // "edgeMask" just contains edges. So to get just the skin pixels, we can remove the edges from it.
-        mask -= edgeMask;
-        // "mask" now just contains 1's in the skin pixels and 0's for non-skin pixels.
+        if (debugType >= 1) {
+            // A caller's cache may belong to a processing thread, where highgui
+            // can not be used, so the mask is handed back through it instead.
+            if (cache == &localCache)
+                cv::imshow("skin mask", mask);
+            else
+                mask.copyTo(cache->debugMask);
+            cv::ellipse(smallImgBGR, cv::Point(sw/2, sh/2), cv::Size(faceW, faceH), 0, 0, 360, CV_RGB(0, 0, 255), 1, cv::LINE_AA);
+        }
 
         auto Red = 0;
         auto Green = 70;
         auto Blue = 0;
-        cv::add(smallImgBGR, cv::Scalar(Blue, Green, Red), smallImgBGR, mask);
+        cv::add(face, cv::Scalar(Blue, Green, Red), face, mask);
+}
+
+
+// True if (x, y) is 0 but all 16 pixels on the ring at distance 2 around it are set,
+// ie. it is part of a speckle of at most 3x3 pixels inside an edge free area.
+static inline bool isPepper(const cv::Mat &src, int y, int x)
+{
+    const uchar *pUp2 = src.ptr(y-2);
+    const uchar *pUp1 = src.ptr(y-1);
+    const uchar *pThis = src.ptr(y);
+    const uchar *pDown1 = src.ptr(y+1);
+    const uchar *pDown2 = src.ptr(y+2);
+    if (pThis[x] != 0)
+        return false;
+    bool allAbove = pUp2[x-2] && pUp2[x-1] && pUp2[x] && pUp2[x+1] && pUp2[x+2];
+    bool allLeft = pUp1[x-2] && pThis[x-2] && pDown1[x-2];
+    bool allBelow = pDown2[x-2] && pDown2[x-1] && pDown2[x] && pDown2[x+1] && pDown2[x+2];
+    bool allRight = pUp1[x+2] && pThis[x+2] && pDown1[x+2];
+    return allAbove && allLeft && allBelow && allRight;
 }
 
+// Writes 255 into hit for every pepper pixel of row y, 16 pixels at a time.
+// Pixels closer than 2 to the left or right border are left untouched.
+static void findPepperRow(const cv::Mat &src, int y, uchar *hit)
+{
+    const uchar *pUp2 = src.ptr(y-2);
+    const uchar *pUp1 = src.ptr(y-1);
+    const uchar *pThis = src.ptr(y);
+    const uchar *pDown1 = src.ptr(y+1);
+    const uchar *pDown2 = src.ptr(y+2);
+    int x = 2;
+#if CV_SIMD128
+    const cv::v_uint8x16 zero = cv::v_setzero_u8();
+    // The lanes of (p == zero) are 0xff where a ring pixel is missing, so the ring is
+    // complete where the OR over all 16 of them is still 0.
+    for (; x + 16 <= src.cols - 2; x += 16) {
+        cv::v_uint8x16 ringMissing =
+            (cv::v_load(pUp2 + x - 2) == zero) | (cv::v_load(pUp2 + x - 1) == zero) |
+            (cv::v_load(pUp2 + x) == zero) | (cv::v_load(pUp2 + x + 1) == zero) |
+            (cv::v_load(pUp2 + x + 2) == zero) |
+            (cv::v_load(pDown2 + x - 2) == zero) | (cv::v_load(pDown2 + x - 1) == zero) |
+            (cv::v_load(pDown2 + x) == zero) | (cv::v_load(pDown2 + x + 1) == zero) |
+            (cv::v_load(pDown2 + x + 2) == zero) |
+            (cv::v_load(pUp1 + x - 2) == zero) | (cv::v_load(pThis + x - 2) == zero) |
+            (cv::v_load(pDown1 + x - 2) == zero) |
+            (cv::v_load(pUp1 + x + 2) == zero) | (cv::v_load(pThis + x + 2) == zero) |
+            (cv::v_load(pDown1 + x + 2) == zero);
+        cv::v_uint8x16 center = cv::v_load(pThis + x) == zero;
+        cv::v_store(hit + x, center & ~ringMissing);
+    }
+#endif
+    for (; x < src.cols - 2; x++) {
+        hit[x] = isPepper(src, y, x) ? 255 : 0;
+    }
+}
 
-void removePepperNoise(cv::Mat &mask) 
+// Despeckles rows [y0, y1) of dst from the unmodified src: every pixel is set
+// if it lies in the 3x3 block around a pepper pixel (a 3x3 dilation of the hits).
+static void removePepperNoiseRows(const cv::Mat &src, cv::Mat &dst, int y0, int y1)
 {
+    int cols = src.cols;
+    // Row i of hits holds the pepper pixels of image row y0-1+i, zero outside the image.
+    cv::Mat hits = cv::Mat::zeros(y1 - y0 + 2, cols, CV_8U);
+    for (auto y = std::max(y0 - 1, 2); y < std::min(y1 + 1, src.rows - 2); y++) {
+        findPepperRow(src, y, hits.ptr(y - y0 + 1));
+    }
+
+    std::vector<uchar> column(cols);
+    uchar *pColumn = column.data();
+    for (auto y = y0; y < y1; y++) {
+        const uchar *pHitUp = hits.ptr(y - y0);
+        const uchar *pHit = hits.ptr(y - y0 + 1);
+        const uchar *pHitDown = hits.ptr(y - y0 + 2);
+        const uchar *pSrc = src.ptr(y);
+        uchar *pDst = dst.ptr(y);
+        int x = 0;
+#if CV_SIMD128
+        for (; x + 16 <= cols; x += 16) {
+            cv::v_store(pColumn + x, cv::v_load(pHitUp + x) | cv::v_load(pHit + x) | cv::v_load(pHitDown + x));
+        }
+#endif
+        for (; x < cols; x++) {
+            pColumn[x] = pHitUp[x] | pHit[x] | pHitDown[x];
+        }
+
+        // Hits never touch the first and last 2 columns, so those keep their value.
+        pDst[0] = pSrc[0];
+        pDst[cols - 1] = pSrc[cols - 1];
+        x = 1;
+#if CV_SIMD128
+        for (; x + 16 <= cols - 1; x += 16) {
+            cv::v_store(pDst + x, cv::v_load(pSrc + x) | cv::v_load(pColumn + x - 1) |
+                                  cv::v_load(pColumn + x) | cv::v_load(pColumn + x + 1));
+        }
+#endif
+        for (; x < cols - 1; x++) {
+            pDst[x] = pSrc[x] | pColumn[x - 1] | pColumn[x] | pColumn[x + 1];
+        }
+    }
+}
+
+// Fills small black speckles (at most 3x3 pixels) surrounded by white in the edge mask.
+// Pepper pixels are detected on a copy of the input, so the result does not depend on the
+// scan order and row strips can be processed in parallel.
+void removePepperNoise(cv::Mat &mask)
+{
+    if (mask.rows < 5 || mask.cols < 5)
+        return;
+    cv::Mat src = mask.clone();
+    // One band of rows per thread, so the halo rows and the scratch buffers of
+    // removePepperNoiseRows() are paid once per band rather than per row.
+    cv::parallel_for_(cv::Range(0, mask.rows), [&](const cv::Range &range) {
+        removePepperNoiseRows(src, mask, range.start, range.end);
+    }, cv::getNumThreads());
+}
+
+// Plain scalar version of removePepperNoise(), kept to check the optimized one is bit exact.
+void removePepperNoiseReference(cv::Mat &mask)
+{
+    cv::Mat src = mask.clone();
     for (auto y = 2; y < mask.rows-2; y++) {
-        uchar *pThis = mask.ptr(y);
-        uchar *pUp1 = mask.ptr(y-1);
-        uchar *pUp2 = mask.ptr(y-2);
-        uchar *pDown1 = mask.ptr(y+1);
-        uchar *pDown2 = mask.ptr(y+2);
-
-        pThis += 2;
-        pUp1 += 2;
-        pUp2 += 2;
-        pDown1 += 2;
-        pDown2 += 2;
-
-        for(auto x = 2; x < mask.rows-2; x++) {
-            uchar v = *pThis;
-            if(v == 0) {
-                bool allAbove = *(pUp2-2) && *(pUp2-1) && *(pUp2) && *(pUp2+1) && *(pUp2+2);
-                bool allLeft = *(pUp1 - 2) && *(pThis - 2) && *(pDown1 - 2);
-                bool allBelow = *(pDown2 - 2) && *(pDown2 - 1) && *(pDown2) && *(pDown2 + 1) && *(pDown2 + 2);
-                bool allRight = *(pUp1 + 2) && *(pThis + 2) && *(pDown1 + 2);
-                bool surroundings = allAbove && allLeft && allBelow && allRight;
-                if(surroundings == true) {
-                    *(pUp1 - 1) = 255;
-                    *(pUp1 + 0) = 255;
-                    *(pUp1 + 1) = 255;
-                    *(pThis - 1) = 255;
-                    *(pThis + 0) = 255;
-                    *(pThis + 1) = 255;
-                    *(pDown1 - 1) = 255;
-                    *(pDown1 + 0) = 255;
-                    *(pDown1 + 1) = 255;
-                }
-                pThis += 2;
-                pUp1 += 2;
-                pUp2 += 2;
-                pDown1 += 2;
-                pDown2 += 2;
+        for (auto x = 2; x < mask.cols-2; x++) {
+            if (isPepper(src, y, x)) {
+                mask(cv::Rect(x-1, y-1, 3, 3)).setTo(255);
             }
-            pThis++;
-            pUp1++;
-            pUp2++;
-            pDown1++;
-            pDown2++;
-        }       
-    }     
+        }
+    }
 }
 
-void drawFaceStickFigure(cv::Mat dst) 
+// Rasterizes the face outline and message at the given frame size.
+static cv::Mat renderFaceStickFigure(cv::Size size)
 {
-    cv::Size size = dst.size();
     int sw = size.width;
     int sh = size.height;
 
@@ -198,5 +360,38 @@ void drawFaceStickFigure(cv::Mat dst)
     auto fontThickness = 2;
     cv::putText(faceOutline, "Put your face here", cv::Point(sw * 23/100, sh * 10/100), fontFace, fontScale, color, fontThickness, cv::LINE_AA);
     
-    addWeighted(dst, 1.0, faceOutline, 0.7, 0, dst, CV_8UC3);
+    return faceOutline;
+}
+
+void drawFaceStickFigure(cv::Mat dst, StickFigureOverlay *overlay)
+{
+    StickFigureOverlay localOverlay;
+    if (!overlay)
+        overlay = &localOverlay;
+
+    // The figure only depends on the frame size, so it is drawn once into a sprite that
+    // is already scaled by the blending weight, and split into tiles of TILE_SIZE pixels.
+    // Only the tiles the figure touches are kept, a small part of the frame.
+    if (overlay->sprite.size() != dst.size()) {
+        const int TILE_SIZE = 32;
+        cv::Mat faceOutline = renderFaceStickFigure(dst.size());
+        faceOutline.convertTo(overlay->sprite, CV_8UC3, 0.7);
+        overlay->tiles.clear();
+        cv::Mat gray;
+        cv::cvtColor(overlay->sprite, gray, cv::COLOR_BGR2GRAY);
+        for (auto y = 0; y < gray.rows; y += TILE_SIZE) {
+            for (auto x = 0; x < gray.cols; x += TILE_SIZE) {
+                cv::Rect tile = cv::Rect(x, y, TILE_SIZE, TILE_SIZE) & cv::Rect(0, 0, gray.cols, gray.rows);
+                if (cv::countNonZero(gray(tile)) > 0)
+                    overlay->tiles.push_back(tile);
+            }
+        }
+    }
+
+    // Same as addWeighted(dst, 1.0, faceOutline, 0.7, 0, dst) over the whole frame,
+    // a saturating add that OpenCV vectorizes.
+    for (size_t i = 0; i < overlay->tiles.size(); i++) {
+        cv::Mat roi = dst(overlay->tiles[i]);
+        cv::add(roi, overlay->sprite(overlay->tiles[i]), roi);
+    }
 }
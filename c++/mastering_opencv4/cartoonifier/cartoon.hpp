@@ -3,11 +3,37 @@
 #include <stdio.h>
 #include <iostream>
 #include <vector>
+#include <functional>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/photo.hpp>
 
-void cartoonifyImage(cv::Mat srcColor, cv::Mat dst, bool sketchMode, bool alienMode, bool evilMode, int debugType);
-void drawFaceStickFigure(cv::Mat dst);
-void changeFacialSkinColor(cv::Mat smallImgBGR, cv::Mat bigEdges, int debugType);
+// Smoothing used for the paint stage, selectable at runtime.
+enum PaintMode {
+    PAINT_BILATERAL,        // 7x2 bilateral filter passes, the original look
+    PAINT_DOMAIN_TRANSFORM, // one recursive domain transform pass, much faster
+    NUM_PAINT_MODES
+};
+
+// Buffers kept between the frames of a video by changeFacialSkinColor(), so the face
+// outline is only drawn again when the frame size changes. Use one per video stream.
+struct SkinCache {
+    cv::Mat faceMask;   // face outline, the region searched for skin
+    cv::Mat skin;       // skin mask of the face region, reused every frame
+    cv::Mat debugMask;  // skin mask of the last frame in debug mode, for the GUI thread to show
+};
+
+// Face outline drawn by drawFaceStickFigure(), cached for the current frame size.
+struct StickFigureOverlay {
+    cv::Mat sprite;                 // outline already scaled by its blending weight
+    std::vector<cv::Rect> tiles;    // the parts of the sprite that are not empty
+};
+
+// tiled splits the filter stages into overlapping horizontal bands that run in parallel.
+void cartoonifyImage(cv::Mat srcColor, cv::Mat dst, bool sketchMode, bool alienMode, bool evilMode, int debugType, int paintMode = PAINT_BILATERAL, bool tiled = false, SkinCache *skinCache = NULL);
+void paintImage(cv::Mat smallImg, int paintMode, bool tiled = false);
+void drawFaceStickFigure(cv::Mat dst, StickFigureOverlay *overlay = NULL);
+void changeFacialSkinColor(cv::Mat smallImgBGR, cv::Mat bigEdges, int debugType, SkinCache *cache = NULL);
 void removePepperNoise(cv::Mat &mask);
+void removePepperNoiseReference(cv::Mat &mask);
 
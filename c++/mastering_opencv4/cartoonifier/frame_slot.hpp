@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <opencv2/core.hpp>
+
+class frame_slot {
+    // Hands the newest frame from a producer thread to a consumer thread.
+    // Frames are passed by swapping cv::Mat headers: the producer fills its own
+    // buffer and swaps it into the slot, the consumer swaps its used buffer out
+    // for the ready one, so buffers are recycled and never copied or reallocated.
+    // If the consumer falls behind, the waiting frame is replaced by the newer one.
+public:
+    frame_slot() : fresh(false), closed(false) {}
+
+    // Producer: swap the filled frame into the slot, getting a free buffer back.
+    void publish(cv::Mat &frame) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(frame, ready);
+            fresh = true;
+        }
+        cond.notify_one();
+    }
+
+    // Consumer: wait up to timeoutMs for a new frame and swap it into frame.
+    // Returns false on timeout or once the slot is closed and drained.
+    bool acquire(cv::Mat &frame, int timeoutMs) {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return fresh || closed; });
+        if (!fresh)
+            return false;
+        std::swap(frame, ready);
+        fresh = false;
+        return true;
+    }
+
+    // Wakes up and stops the consumer, eg. at the end of the stream.
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        cond.notify_all();
+    }
+
+    bool isClosed() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return closed && !fresh;
+    }
+
+private:
+    cv::Mat ready;
+    bool fresh;
+    bool closed;
+    std::mutex mutex;
+    std::condition_variable cond;
+};
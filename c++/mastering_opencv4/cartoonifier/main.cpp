@@ -1,9 +1,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <atomic>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include "cartoon.hpp"
 #include "fps_timer.hpp"
+#include "frame_slot.hpp"
+#include "batch.hpp"
 
 const int DEFAULT_CAMERA_WIDTH = 640;
 const int DEFAULT_CAMERA_HEIGHT = 480;
@@ -11,12 +15,18 @@ const char *DEFAULT_CAMERA_NUMBER = "0";
 const int NUM_STICK_FIGURE_ITERATIONS = 40;
 const char *windowName = "Cartoonifier";
 
-auto m_sketchMode = true;
-auto m_alienMode = false;
-auto m_evilMode = false;
-auto m_debugMode = false;
+// Set by the key handler on the GUI thread, read by the processing thread.
+std::atomic<bool> m_sketchMode(true);
+std::atomic<bool> m_alienMode(false);
+std::atomic<bool> m_evilMode(false);
+std::atomic<bool> m_debugMode(false);
+std::atomic<int> m_paintMode(PAINT_BILATERAL);
+std::atomic<bool> m_tiledMode(false);
 
-int m_stickFigureIterations = 0;
+std::atomic<int> m_stickFigureIterations(0);
+
+std::atomic<bool> m_quit(false);
+std::atomic<bool> m_cameraFailed(false);
 
 #if !defined VK_ESCAPE
     #define VK_ESCAPE 0x1B
@@ -64,14 +74,91 @@ void onKeyPress(char key) {
         m_debugMode = !m_debugMode;
         std::cout << "Debug Mode:" << m_debugMode << std::endl;
         break;
+    case 'p':
+        m_paintMode = (m_paintMode + 1) % NUM_PAINT_MODES;
+        std::cout << "Paint Mode (0 bilateral, 1 domain transform):" << m_paintMode << std::endl;
+        break;
+    case 't':
+        m_tiledMode = !m_tiledMode;
+        std::cout << "Tiled / Whole frame Mode:" << m_tiledMode << std::endl;
+        break;
+    }
+}
+
+
+// Grabs camera frames until quit or the end of the stream.
+void captureLoop(cv::VideoCapture &camera, frame_slot &capturedFrames) {
+    cv::Mat cameraFrame;
+    while(!m_quit) {
+        camera >> cameraFrame;
+        if(cameraFrame.empty()){
+            std::cerr << "ERROR: Couldn't grab the next camera frame." << std::endl;
+            m_cameraFailed = true;
+            break;
+        }
+        capturedFrames.publish(cameraFrame);
     }
+    capturedFrames.close();
 }
 
+// Cartoonifies the newest captured frame, dropping frames it can not keep up with.
+// In debug mode the skin mask goes to debugFrames, as only the GUI thread may show it.
+// The timings of the last frames are written to statsFile at exit, if given.
+void processLoop(frame_slot &capturedFrames, frame_slot &displayedFrames, frame_slot &debugFrames, const char *statsFile) {
+    fps_timer timer;
+    SkinCache skinCache;
+    StickFigureOverlay stickFigure;
+    cv::Mat cameraFrame;
+    cv::Mat displayedFrame;
+    while(true) {
+        if (!capturedFrames.acquire(cameraFrame, 100)) {
+            if (capturedFrames.isClosed())
+                break;
+            continue;
+        }
+        timer.mark("wait");
+        displayedFrame.create(cameraFrame.size(), CV_8UC3);
+        auto debugType = 0;
+        if(m_debugMode) {
+            debugType = 2;
+        }
+        cartoonifyImage(cameraFrame, displayedFrame, m_sketchMode, m_alienMode, m_evilMode, debugType, m_paintMode, m_tiledMode, &skinCache);
+        if (debugType && !skinCache.debugMask.empty()) {
+            // publish() swaps back the previous mask, which must not be shown
+            // again once a frame produces none, eg. after leaving alien mode.
+            debugFrames.publish(skinCache.debugMask);
+            skinCache.debugMask.release();
+        }
+        timer.mark("cartoonify");
+        if (m_stickFigureIterations > 0) {
+            drawFaceStickFigure(displayedFrame, &stickFigure);
+            m_stickFigureIterations--;
+        }
+        timer.mark("overlay");
+
+        timer.increment();
+        if (timer.fnum == 0) {
+            double fps;
+            if (timer.fps < 1.0f)
+                fps = timer.fps;                // FPS is a fraction
+            else
+                fps = (int)(timer.fps + 0.5f);  // FPS is a large number
+            std::cout << fps << " FPS, ";
+            timer.print_stats();
+        }
+        displayedFrames.publish(displayedFrame);
+    }
+    displayedFrames.close();
+    if (statsFile && !timer.write_csv(statsFile)) {
+        std::cerr << "ERROR: could not write " << statsFile << std::endl;
+    }
+}
 
 int main(int argc, char **argv) {
     std::cout << "Converts real-life images to cartoon-like images." << std::endl;
     std::cout << "Compiled with OpenCV version " << CV_VERSION << std::endl;
-    std::cout << "usage:   " << argv[0] << " [[camera_number] desired_width desired_height ]" << std::endl;
+    std::cout << "usage:   " << argv[0] << " [[camera_number] desired_width desired_height [frame_stats.csv] ]" << std::endl;
+    std::cout << "         " << argv[0] << " --batch input_video output_video [num_workers [sketch]]" << std::endl;
     std::cout << "default: " << argv[0] << " " << DEFAULT_CAMERA_NUMBER << " " << DEFAULT_CAMERA_WIDTH << " " << DEFAULT_CAMERA_HEIGHT << std::endl;
     std::cout << std::endl;
 
@@ -81,11 +168,21 @@ int main(int argc, char **argv) {
     std::cout << "    a:    change Alien / Human mode." << std::endl;
     std::cout << "    e:    change Evil / Good character mode." << std::endl;
     std::cout << "    d:    change debug mode." << std::endl;
+    std::cout << "    p:    change paint filter (bilateral / domain transform)." << std::endl;
+    std::cout << "    t:    change tiled multi-threaded / whole frame processing." << std::endl;
     std::cout << std::endl;
 
+    // Render a video file to another file without a window, as fast as possible.
+    if (argc > 3 && std::string(argv[1]) == "--batch") {
+        int numWorkers = (argc > 4) ? atoi(argv[4]) : 0;
+        bool sketchMode = (argc > 5) && std::string(argv[5]) == "sketch";
+        return cartoonifyVideo(argv[2], argv[3], numWorkers, sketchMode, m_paintMode);
+    }
+
     char *cameraNumber = (char*)DEFAULT_CAMERA_NUMBER;
     int desiredCameraWidth = DEFAULT_CAMERA_WIDTH;
     int desiredCameraHeight = DEFAULT_CAMERA_HEIGHT;
+    const char *statsFile = NULL;
     
     auto a = 1;
     if (argc > a) {
@@ -100,6 +197,12 @@ int main(int argc, char **argv) {
             if (argc > a) {
                 desiredCameraHeight = atoi(argv[a]);
                 a++;    // Next arg
+
+                // Per frame timings of the last few hundred frames, written at exit.
+                if (argc > a) {
+                    statsFile = argv[a];
+                    a++;    // Next arg
+                }
             }
         }
     }
@@ -113,38 +216,28 @@ int main(int argc, char **argv) {
     namedWindow(windowName, cv::WINDOW_NORMAL);
     // cv::setWindowProperty(windowName, cv::WND_PROP_FULLSCREEN, cv::WINDOW_FULLSCREEN);
     
-    fps_timer timer;
-    
+    // Capture, cartoonify and display run on their own threads, passing the newest
+    // frame along through frame slots, so decoding, filtering and drawing overlap.
+    frame_slot capturedFrames;
+    frame_slot displayedFrames;
+    frame_slot debugFrames;
+    std::thread captureThread(captureLoop, std::ref(camera), std::ref(capturedFrames));
+    std::thread processThread(processLoop, std::ref(capturedFrames), std::ref(displayedFrames), std::ref(debugFrames), statsFile);
+
+    // The GUI has to stay on the main thread. It only waits for new frames
+    // and polls the keyboard, so it never limits the processing rate.
+    cv::Mat displayedFrame;
+    cv::Mat debugFrame;
     while(true) {
-        cv::Mat cameraFrame;    
-        camera >> cameraFrame;
-        if(cameraFrame.empty()){
-            std::cerr << "ERROR: Couldn't grab the next camera frame." << std::endl;
-            exit(1);
-        }
-        cv::Mat displayedFrame = cv::Mat(cameraFrame.size(), CV_8UC3);
-        auto debugType = 0;
-        if(m_debugMode) {
-            debugType = 2;
+        if (displayedFrames.acquire(displayedFrame, 10)) {
+            cv::imshow(windowName, displayedFrame);
+        } else if (displayedFrames.isClosed()) {
+            break;
         }
-        cartoonifyImage(cameraFrame, displayedFrame, m_sketchMode, m_alienMode, m_evilMode, debugType);
-        if (m_stickFigureIterations > 0) {
-            drawFaceStickFigure(displayedFrame);
-            m_stickFigureIterations--;
+        if (debugFrames.acquire(debugFrame, 0)) {
+            cv::imshow("skin mask", debugFrame);
         }
-        
-        timer.increment();
-        if (timer.fnum == 0) {
-            double fps;
-            if (timer.fps < 1.0f)
-                fps = timer.fps;                // FPS is a fraction
-            else
-                fps = (int)(timer.fps + 0.5f);  // FPS is a large number
-            std::cout << fps << " FPS" << std::endl;
-        }
-
-        cv::imshow(windowName, displayedFrame);
-        auto keypress = cv::waitKey(20);  // This is needed if you want to see anything!
+        auto keypress = cv::waitKey(1);  // This is needed if you want to see anything!
         if (keypress == VK_ESCAPE) {   // Escape Key
             // Quit the program!
             break;
@@ -154,5 +247,12 @@ int main(int argc, char **argv) {
             onKeyPress(keypress);
         }
     } // end while
+
+    m_quit = true;
+    captureThread.join();
+    processThread.join();
+    if (m_cameraFailed) {
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include "percentile.hpp"
+
+class fps_timer {
+    // frames/second timer for tracking
+    // Also keeps the durations of the last `window` frames in a ring buffer, optionally
+    // split into named stages with mark(), to report latency percentiles and jitter.
+public:
+    int64 t_start;
+    int64 t_end;
+    float fps;
+    int fnum;
+
+    fps_timer(int window = 300) {
+        this->window = std::max(window, 1);
+        this->reset();
+    }
+
+    void increment() {
+        int64 now = cv::getTickCount();
+        push_frame(ticks_to_ms(now - t_frame));
+        t_frame = now;
+        t_mark = now;
+
+        if(fnum >= 29) {
+            t_end = now;
+            fps = 30.0 / (float(t_end - t_start)/cv::getTickFrequency());
+            t_start = t_end;
+            fnum = 0;
+        } else
+            fnum += 1;
+    }
+
+    // Charges the time since the previous mark (or the start of the frame) to stage.
+    void mark(const std::string &stage) {
+        int64 now = cv::getTickCount();
+        size_t s = stage_index(stage);
+        current[s] += ticks_to_ms(now - t_mark);
+        t_mark = now;
+    }
+
+    void reset() {
+        t_start = cv::getTickCount();
+        t_frame = t_start;
+        t_mark = t_start;
+        fps = 0;
+        fnum = 0;
+        frames.clear();
+        stage_names.clear();
+        stages.clear();
+        current.clear();
+        head = 0;
+        total_frames = 0;
+    }
+
+    // Number of frames currently in the window.
+    int count() const {
+        return (int)frames.size();
+    }
+
+    // Frame duration in ms at percentile p (0..100) over the window,
+    // or of a single stage if one is given.
+    double percentile(double p, const std::string &stage = "") const {
+        std::vector<double> values;
+        if (stage.empty()) {
+            values = frames;
+        } else {
+            for (size_t s = 0; s < stage_names.size(); s++)
+                if (stage_names[s] == stage)
+                    values = stages[s];
+        }
+        return ::percentile(values, p);
+    }
+
+    double mean() const {
+        double sum = 0;
+        for (size_t i = 0; i < frames.size(); i++)
+            sum += frames[i];
+        return frames.empty() ? 0 : sum / frames.size();
+    }
+
+    // Standard deviation of the frame durations in ms.
+    double jitter() const {
+        double m = mean();
+        double sum = 0;
+        for (size_t i = 0; i < frames.size(); i++)
+            sum += (frames[i] - m) * (frames[i] - m);
+        return frames.empty() ? 0 : std::sqrt(sum / frames.size());
+    }
+
+    // One line summary, eg. "p50 33.1 ms, p95 35.0 ms, p99 40.2 ms, jitter 1.2 ms | cartoonify p50 20.3 ms"
+    void print_stats(std::ostream &out = std::cout) const {
+        out << "p50 " << percentile(50) << " ms, p95 " << percentile(95) << " ms, p99 " << percentile(99)
+            << " ms, jitter " << jitter() << " ms";
+        for (size_t s = 0; s < stage_names.size(); s++)
+            out << " | " << stage_names[s] << " p50 " << percentile(50, stage_names[s]) << " ms";
+        out << std::endl;
+    }
+
+    // Writes the frames in the window, oldest first: frame number, total ms, then ms per stage.
+    bool write_csv(const std::string &filename) const {
+        std::ofstream file(filename.c_str());
+        if (!file.is_open())
+            return false;
+        file << "frame,total_ms";
+        for (size_t s = 0; s < stage_names.size(); s++)
+            file << "," << stage_names[s] << "_ms";
+        file << "\n";
+        size_t n = frames.size();
+        size_t oldest = (n < (size_t)window) ? 0 : head;
+        for (size_t i = 0; i < n; i++) {
+            size_t r = (oldest + i) % n;
+            file << (total_frames - n + i) << "," << frames[r];
+            for (size_t s = 0; s < stages.size(); s++)
+                file << "," << stages[s][r];
+            file << "\n";
+        }
+        return file.good();
+    }
+
+    void display_fps(cv::Mat& im, cv::Point2d p = cv::Point2f(-1, -1)) {
+        cv::Point2d pt;
+        if(p.y < 0)
+            pt = cv::Point2d(10, im.rows-20);
+        else
+            pt = p;
+        std::string text = cv::format("%d frames/sec", (int)cvRound(fps));
+        cv::putText(im, text, pt, cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar::all(255));
+    }
+
+private:
+    int window;
+    int64 t_frame;              // start of the current frame
+    int64 t_mark;               // last mark() in the current frame
+    std::vector<double> frames; // ring buffer of frame durations in ms
+    std::vector<std::string> stage_names;
+    std::vector<std::vector<double> > stages;   // per stage ring buffers, same layout as frames
+    std::vector<double> current;                // stage times of the current frame
+    size_t head;                // next ring position to overwrite once full
+    size_t total_frames;
+
+    static double ticks_to_ms(int64 ticks) {
+        return ticks * 1000.0 / cv::getTickFrequency();
+    }
+
+    size_t stage_index(const std::string &stage) {
+        for (size_t s = 0; s < stage_names.size(); s++)
+            if (stage_names[s] == stage)
+                return s;
+        // A stage first seen now has no time in the earlier frames.
+        stage_names.push_back(stage);
+        stages.push_back(std::vector<double>(frames.size(), 0.0));
+        current.push_back(0.0);
+        return stage_names.size() - 1;
+    }
+
+    void push_frame(double ms) {
+        if (frames.size() < (size_t)window) {
+            frames.push_back(ms);
+            for (size_t s = 0; s < stages.size(); s++)
+                stages[s].push_back(current[s]);
+        } else {
+            frames[head] = ms;
+            for (size_t s = 0; s < stages.size(); s++)
+                stages[s][head] = current[s];
+            head = (head + 1) % window;
+        }
+        std::fill(current.begin(), current.end(), 0.0);
+        total_frames++;
+    }
+};
@@ -0,0 +1,22 @@
+#ifndef Percentile_hpp
+#define Percentile_hpp
+
+#include <algorithm>
+#include <vector>
+
+// Value at percentile p (0..100) of values, nearest rank on the sorted
+// values: p 0 is the minimum, p 100 the maximum. 0 if there are none.
+// Shared by the timing reports of the carplates and cartoonifier projects
+// so their p50/p95/p99 figures are comparable.
+inline double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    p = std::min(std::max(p, 0.0), 100.0);
+    size_t k = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include <fstream>
+#include <sstream>
+#include <boost/format.hpp>
+
+#include "annotation.hpp"
+
+using $ = boost::format;
+
+std::string annotationFileName(const std::string &vid_base, int frame_ID)
+{
+    return str($(vid_base + "/annot/%06d.pts") % frame_ID);
+}
+
+std::vector<cv::Point2f> readAnnotationFile(const std::string &file) 
+{
+    std::ifstream in(file);
+    std::string line;
+    for (int i = 0; i < 3; i++) {
+        std::getline(in, line);
+    }
+    std::vector<cv::Point2f> points;
+    while (std::getline(in, line)) {
+        std::stringstream l(line);
+        cv::Point2f p;
+        l >> p.x >> p.y;
+        if (p.x != 0.0 and p.y != 0.0) {
+            points.push_back(p);
+        }
+    }
+    return points;
+}
+
+float calMeanEuclideanDistance(const std::vector<cv::Point2f> &A, 
+                               const std::vector<cv::Point2f> &B)
+{
+    float med = 0.0f;
+    for (size_t i = 0; i < A.size(); i++) {
+        med += cv::norm(A[i] - B[i]);
+    }
+    return med / (float)A.size();
+}
+
+float calMeanEuclideanDistance(const std::vector<cv::Point2f> &A, 
+                               const cv::Point2f *B, float scale_B)
+{
+    float med = 0.0f;
+    for (size_t i = 0; i < A.size(); i++) {
+        med += cv::norm(A[i] - B[i] * scale_B);
+    }
+    return med / (float)A.size();
+}
@@ -0,0 +1,21 @@
+#ifndef Annotation_hpp
+#define Annotation_hpp
+
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+// path of the 300-VW style annotation of a frame: vid_base/annot/%06d.pts
+std::string annotationFileName(const std::string &vid_base, int frame_ID);
+
+// reads the landmarks of a .pts file, empty if the file can not be read
+std::vector<cv::Point2f> readAnnotationFile(const std::string &file);
+
+float calMeanEuclideanDistance(const std::vector<cv::Point2f> &A,
+                               const std::vector<cv::Point2f> &B);
+// same, with A.size() points of B scaled by scale_B
+float calMeanEuclideanDistance(const std::vector<cv::Point2f> &A,
+                               const cv::Point2f *B, float scale_B);
+
+#endif
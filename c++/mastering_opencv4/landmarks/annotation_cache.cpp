@@ -0,0 +1,197 @@
+#include "annotation_cache.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "annotation.hpp"
+
+static const char magic[8] = {'L', 'M', 'K', 'A', 'N', 'N', 'O', '1'};
+static const size_t header_size = sizeof(magic) + 2*sizeof(int32_t);
+
+AnnotationCache::AnnotationCache()
+{
+    map = NULL;
+    map_size = 0;
+    num_IDs = 0;
+    offsets = NULL;
+    all_points = NULL;
+}
+
+AnnotationCache::~AnnotationCache()
+{
+    close();
+}
+
+std::string AnnotationCache::defaultPath(const std::string &vid_base)
+{
+    return vid_base + "/annot.bin";
+}
+
+bool AnnotationCache::open(const std::string &path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 or (size_t)st.st_size < header_size) {
+        ::close(fd);
+        return false;
+    }
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) {
+        return false;
+    }
+    map = m;
+    map_size = st.st_size;
+    return attach((const char *)map, map_size, path);
+}
+
+bool AnnotationCache::load(const std::string &vid_base)
+{
+    close();
+    pack(vid_base, buffer);
+    return attach(buffer.data(), buffer.size(), vid_base);
+}
+
+bool AnnotationCache::attach(const char *p, size_t size, const std::string &name)
+{
+    int32_t ids, num_points;
+    std::memcpy(&ids, p + sizeof(magic), sizeof(ids));
+    std::memcpy(&num_points, p + sizeof(magic) + sizeof(ids), sizeof(num_points));
+    size_t expected = header_size + (size_t)(ids + 1)*sizeof(int32_t) +
+                      (size_t)num_points*sizeof(cv::Point2f);
+    if (std::memcmp(p, magic, sizeof(magic)) != 0 or ids < 0 or num_points < 0 or
+        expected != size) {
+        std::cerr << "Invalid annotation cache: " << name << std::endl;
+        close();
+        return false;
+    }
+    num_IDs = ids;
+    offsets = (const int32_t *)(p + header_size);
+    all_points = (const cv::Point2f *)(p + header_size + (size_t)(ids + 1)*sizeof(int32_t));
+    return true;
+}
+
+void AnnotationCache::close()
+{
+    if (map) {
+        munmap(map, map_size);
+        map = NULL;
+        map_size = 0;
+    }
+    std::vector<char>().swap(buffer);
+    num_IDs = 0;
+    offsets = NULL;
+    all_points = NULL;
+}
+
+const cv::Point2f *AnnotationCache::points(int frame_ID, int &count) const
+{
+    if (frame_ID < 0 or frame_ID >= num_IDs) {
+        count = 0;
+        return NULL;
+    }
+    count = offsets[frame_ID + 1] - offsets[frame_ID];
+    return all_points + offsets[frame_ID];
+}
+
+void AnnotationCache::pack(const std::string &vid_base, std::vector<char> &data)
+{
+    std::vector<cv::String> files;
+    cv::glob(vid_base + "/annot/*.pts", files, false);
+
+    // the frame ID is the file name, eg. annot/000042.pts
+    std::vector<std::vector<cv::Point2f> > frames;
+    for (const cv::String &file : files) {
+        size_t slash = file.find_last_of('/');
+        int frame_ID = std::atoi(file.c_str() + (slash == cv::String::npos ? 0 : slash + 1));
+        if (frame_ID < 0) {
+            continue;
+        }
+        if (frame_ID >= (int)frames.size()) {
+            frames.resize(frame_ID + 1);
+        }
+        frames[frame_ID] = readAnnotationFile(file);
+    }
+
+    std::vector<int32_t> offsets(1, 0);
+    for (const std::vector<cv::Point2f> &points : frames) {
+        offsets.push_back(offsets.back() + (int32_t)points.size());
+    }
+
+    int32_t ids = frames.size();
+    int32_t num_points = offsets.back();
+    data.resize(header_size + offsets.size()*sizeof(int32_t) +
+                (size_t)num_points*sizeof(cv::Point2f));
+    char *p = data.data();
+    std::memcpy(p, magic, sizeof(magic));
+    std::memcpy(p + sizeof(magic), &ids, sizeof(ids));
+    std::memcpy(p + sizeof(magic) + sizeof(ids), &num_points, sizeof(num_points));
+    p += header_size;
+    std::memcpy(p, offsets.data(), offsets.size()*sizeof(int32_t));
+    p += offsets.size()*sizeof(int32_t);
+    for (const std::vector<cv::Point2f> &points : frames) {
+        std::memcpy(p, points.data(), points.size()*sizeof(cv::Point2f));
+        p += points.size()*sizeof(cv::Point2f);
+    }
+}
+
+bool AnnotationCache::build(const std::string &vid_base, const std::string &path)
+{
+    std::vector<char> data;
+    pack(vid_base, data);
+
+    // written next to the cache and renamed, so a failed write never leaves
+    // a truncated cache behind
+    const std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path.c_str(), std::ios::binary);
+    if (not out) {
+        return false;
+    }
+    out.write(data.data(), data.size());
+    out.close();
+    if (not out.good() or std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool newerThan(const std::string &file, const struct stat &reference)
+{
+    struct stat st;
+    return stat(file.c_str(), &st) == 0 and st.st_mtime > reference.st_mtime;
+}
+
+bool AnnotationCache::isStale(const std::string &vid_base, const std::string &path)
+{
+    struct stat cache;
+    if (stat(path.c_str(), &cache) != 0) {
+        return true;
+    }
+    // adding or removing a .pts file touches the directory, editing one the file
+    if (newerThan(vid_base + "/annot", cache)) {
+        return true;
+    }
+    std::vector<cv::String> files;
+    cv::glob(vid_base + "/annot/*.pts", files, false);
+    for (const cv::String &file : files) {
+        if (newerThan(file, cache)) {
+            return true;
+        }
+    }
+    return false;
+}
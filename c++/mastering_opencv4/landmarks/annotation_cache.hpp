@@ -0,0 +1,47 @@
+#ifndef AnnotationCache_hpp
+#define AnnotationCache_hpp
+
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+// All landmark annotations of a video packed into one file, mapped read-only
+// so every frame's points are read in place. Layout (native endianness):
+//   char[8] magic "LMKANNO1", int32 num_IDs (highest frame ID + 1),
+//   int32 num_points, int32 offsets[num_IDs + 1] (first point of each frame
+//   ID, frames without annotation have none), float32 x, y per point
+// Where the cache can not be written, load() packs the same layout in memory.
+class AnnotationCache
+{
+public:
+    AnnotationCache();
+    ~AnnotationCache();
+    bool open(const std::string &path);
+    // packs vid_base/annot/*.pts in memory, without a cache file
+    bool load(const std::string &vid_base);
+    void close();
+    // packs vid_base/annot/*.pts into path
+    static bool build(const std::string &vid_base, const std::string &path);
+    // whether path is missing or older than vid_base/annot or any .pts in it
+    static bool isStale(const std::string &vid_base, const std::string &path);
+    // conventional location of the cache of a video
+    static std::string defaultPath(const std::string &vid_base);
+
+    // points of a frame, valid until close(); count is 0 if not annotated
+    const cv::Point2f *points(int frame_ID, int &count) const;
+
+private:
+    AnnotationCache(const AnnotationCache &);
+    AnnotationCache &operator=(const AnnotationCache &);
+    static void pack(const std::string &vid_base, std::vector<char> &data);
+    bool attach(const char *data, size_t size, const std::string &name);
+    void *map;
+    std::vector<char> buffer;   // packed annotations when not mapped
+    size_t map_size;
+    int num_IDs;
+    const int32_t *offsets;
+    const cv::Point2f *all_points;
+};
+
+#endif
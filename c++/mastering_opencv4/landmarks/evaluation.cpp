@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <boost/format.hpp>
+
+#include "opencv2/imgproc.hpp"
+#include "opencv2/videoio.hpp"
+
+#include "annotation.hpp"
+#include "annotation_cache.hpp"
+#include "evaluation.hpp"
+#include "landmark_tracker.hpp"
+
+using $ = boost::format;
+
+// frames are evaluated at the width the viewer uses, MED is in those pixels
+static const int EVAL_WIDTH = 700;
+static const int CHUNK_SIZE = 64;
+
+struct Chunk
+{
+    std::vector<cv::Mat> frames;
+    std::vector<int> frame_IDs;
+    std::vector<float> scale_factors;
+};
+
+struct FrameResult
+{
+    int frame_ID;
+    bool found;       // a face was detected and fitted
+    bool annotated;   // ground truth with as many points as the model
+    float med;
+    double ms;        // detection and fitting time
+};
+
+// decodes the next CHUNK_SIZE frames, resized
+static Chunk readChunk(cv::VideoCapture &cap)
+{
+    Chunk chunk;
+    cv::Mat org_img;
+    while ((int)chunk.frames.size() < CHUNK_SIZE and cap.read(org_img)) {
+        const int frame_ID = cap.get(cv::CAP_PROP_POS_FRAMES);
+        const float scale_factor = EVAL_WIDTH / (float)org_img.cols;
+        cv::Size small_size(EVAL_WIDTH, EVAL_WIDTH * (float)org_img.rows / (float)org_img.cols);
+        cv::Mat img;
+        cv::resize(org_img, img, small_size, 0, 0, cv::INTER_LINEAR_EXACT);
+        chunk.frames.push_back(img);
+        chunk.frame_IDs.push_back(frame_ID);
+        chunk.scale_factors.push_back(scale_factor);
+    }
+    return chunk;
+}
+
+// ground truth is read in place from the annotation cache, at the original scale
+static FrameResult fitFrame(const cv::Mat &img, int frame_ID, float scale_factor,
+                            const AnnotationCache &annotations,
+                            cv::Ptr<cv::face::Facemark> facemark,
+                            cv::CascadeClassifier &face_cascade)
+{
+    FrameResult result = {frame_ID, false, false, 0.0f, 0.0};
+    const int64 t = cv::getTickCount();
+    std::vector<cv::Rect> faces;
+    detectFace(img, faces, face_cascade);
+    std::vector<std::vector<cv::Point2f> > shapes;
+    if (not faces.empty() and facemark->fit(img, faces, shapes) and not shapes.empty()) {
+        result.found = true;
+        int count = 0;
+        const cv::Point2f *ground_truth = annotations.points(frame_ID, count);
+        result.annotated = (int)shapes[0].size() == count;
+        if (result.annotated) {
+            result.med = calMeanEuclideanDistance(shapes[0], ground_truth, scale_factor);
+        }
+    }
+    result.ms = (cv::getTickCount() - t) * 1000.0 / cv::getTickFrequency();
+    return result;
+}
+
+static void printSummary(const std::string &name, const std::vector<FrameResult> &results,
+                         double seconds)
+{
+    std::vector<float> meds;
+    double total_ms = 0;
+    int found = 0;
+    for (const FrameResult &r : results) {
+        found += r.found;
+        total_ms += r.ms;
+        if (r.found and r.annotated) {
+            meds.push_back(r.med);
+        }
+    }
+    std::cout << str($("%s: %d frames, %d with a face, %d compared, %.1f frames/sec, "
+                       "%.1f ms/frame per worker")
+                     % name % results.size() % found % meds.size()
+                     % (results.size() / std::max(seconds, 1e-6))
+                     % (total_ms / std::max<size_t>(results.size(), 1)));
+    if (not meds.empty()) {
+        std::sort(meds.begin(), meds.end());
+        double sum = 0;
+        for (float med : meds) {
+            sum += med;
+        }
+        std::cout << str($(", MED mean %.3f median %.3f p90 %.3f max %.3f")
+                         % (sum / meds.size()) % meds[meds.size() / 2]
+                         % meds[std::min(meds.size() - 1, meds.size() * 9 / 10)]
+                         % meds.back());
+    }
+    std::cout << std::endl;
+}
+
+bool openAnnotations(const std::string &vid_base, AnnotationCache &annotations)
+{
+    const std::string path = AnnotationCache::defaultPath(vid_base);
+    if (not AnnotationCache::isStale(vid_base, path) and annotations.open(path)) {
+        return true;
+    }
+    std::cout << "Packing the annotations of " << vid_base << " into " << path << std::endl;
+    if (AnnotationCache::build(vid_base, path) and annotations.open(path)) {
+        return true;
+    }
+    // eg. a read-only dataset: the .pts files are still read, once per run
+    std::cout << "Can not write " << path << ", reading the .pts files instead" << std::endl;
+    return annotations.load(vid_base);
+}
+
+int evaluateLandmarks(const std::string &vid_base,
+                      const std::string &model_file,
+                      const std::string &cascade_name,
+                      const std::string &report)
+{
+    std::vector<cv::String> videos;
+    cv::glob(vid_base + "/vid.avi", videos, true);
+    std::sort(videos.begin(), videos.end());
+    if (videos.empty()) {
+        std::cerr << "No vid.avi found under " << vid_base << std::endl;
+        return -1;
+    }
+
+    // detectMultiScale keeps scratch buffers in the classifier and
+    // FacemarkLBF::fit stores the face box in its parameters, so every
+    // worker gets its own of both
+    const int workers = std::max(1, cv::getNumThreads());
+    std::vector<cv::CascadeClassifier> cascades(workers);
+    std::vector<cv::Ptr<cv::face::Facemark> > facemarks(workers);
+    for (int w = 0; w < workers; w++) {
+        if (not cascades[w].load(cascade_name)) {
+            std::cerr << "Failed to load cascade classifier: " << cascade_name << std::endl;
+            return -1;
+        }
+        facemarks[w] = cv::face::createFacemarkLBF();
+        facemarks[w]->loadModel(model_file);
+    }
+
+    std::ofstream report_file;
+    if (not report.empty()) {
+        report_file.open(report);
+        report_file << "video,frame,found,med,ms\n";
+    }
+
+    std::vector<FrameResult> all_results;
+    double all_seconds = 0;
+    for (const cv::String &video : videos) {
+        const std::string video_dir = video.substr(0, video.size() - std::string("/vid.avi").size());
+        cv::VideoCapture cap(video);
+        if (not cap.isOpened()) {
+            std::cerr << "Failed to open video " << video << std::endl;
+            continue;
+        }
+        // the annotations are packed and mapped once per video
+        AnnotationCache annotations;
+        if (not openAnnotations(video_dir, annotations)) {
+            std::cerr << "Failed to read the annotations of " << video_dir << std::endl;
+            continue;
+        }
+
+        std::vector<FrameResult> results;
+        const int64 t = cv::getTickCount();
+        std::future<Chunk> next = std::async(std::launch::async, readChunk, std::ref(cap));
+        for (;;) {
+            Chunk chunk = next.get();
+            if (chunk.frames.empty()) {
+                break;
+            }
+            // decode the next chunk meanwhile
+            next = std::async(std::launch::async, readChunk, std::ref(cap));
+
+            const int n = chunk.frames.size();
+            std::vector<FrameResult> chunk_results(n);
+            cv::parallel_for_(cv::Range(0, workers), [&](const cv::Range &range) {
+                for (int w = range.start; w < range.end; w++) {
+                    for (int i = w; i < n; i += workers) {
+                        chunk_results[i] = fitFrame(chunk.frames[i], chunk.frame_IDs[i],
+                                                    chunk.scale_factors[i], annotations,
+                                                    facemarks[w], cascades[w]);
+                    }
+                }
+            });
+            results.insert(results.end(), chunk_results.begin(), chunk_results.end());
+        }
+        const double seconds = (cv::getTickCount() - t) / cv::getTickFrequency();
+
+        printSummary(video_dir, results, seconds);
+        if (report_file.is_open()) {
+            for (const FrameResult &r : results) {
+                report_file << str($("%s,%d,%d,%.4f,%.3f\n") % video_dir % r.frame_ID % r.found
+                                   % (r.annotated ? r.med : -1.0f) % r.ms);
+            }
+        }
+        all_results.insert(all_results.end(), results.begin(), results.end());
+        all_seconds += seconds;
+    }
+    if (videos.size() > 1) {
+        printSummary("all videos", all_results, all_seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef Evaluation_hpp
+#define Evaluation_hpp
+
+#include <string>
+
+#include "opencv2/face.hpp"
+
+#include "annotation_cache.hpp"
+
+// maps the annotation cache of a video, packing it first if there is none or
+// it is older than the .pts files; reads them into memory if it can not be written
+bool openAnnotations(const std::string &vid_base, AnnotationCache &annotations);
+
+// Runs the face detector and facemark on every frame of every vid.avi under
+// vid_base and compares the landmarks with the annot/%06d.pts ground truth.
+// Frames are fitted in parallel chunks while the next chunk is decoded, each
+// worker with its own copy of the model_file LBF model; the ground truth is
+// read from each video's annotation cache.
+// Prints the mean euclidean distance (MED) statistics and frames/sec per
+// video and overall, and writes one line per frame to report if given.
+int evaluateLandmarks(const std::string &vid_base,
+                      const std::string &model_file,
+                      const std::string &cascade_name,
+                      const std::string &report = "");
+
+#endif
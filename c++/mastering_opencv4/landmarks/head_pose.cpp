@@ -0,0 +1,208 @@
+#include <cmath>
+#include <limits>
+
+#include "opencv2/calib3d.hpp"
+#include "head_pose.hpp"
+
+HeadPoseTracker::HeadPoseTracker(const std::vector<cv::Point3f> &object_points,
+                                 const cv::Matx33d &camera_matrix)
+    : object_points(object_points), K(camera_matrix)
+{
+    for (const cv::Point3f &p : object_points) {
+        model.push_back(cv::Vec3d(p.x, p.y, p.z));
+    }
+    max_iterations = 10;
+    max_error = 5.0;
+    max_jump = 50.0;
+}
+
+void HeadPoseTracker::reset()
+{
+    poses.clear();
+}
+
+// sum of squared reprojection errors, infinite if a point is behind the camera
+double HeadPoseTracker::cost(const std::vector<cv::Point2f> &points, const cv::Matx33d &R,
+                             const cv::Vec3d &t) const
+{
+    double sum = 0;
+    for (size_t i = 0; i < model.size(); i++) {
+        cv::Vec3d X = R * model[i] + t;
+        if (X[2] <= 1e-6) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double du = K(0, 0) * X[0] / X[2] + K(0, 2) - points[i].x;
+        double dv = K(1, 1) * X[1] / X[2] + K(1, 2) - points[i].y;
+        sum += du * du + dv * dv;
+    }
+    return sum;
+}
+
+// Levenberg-Marquardt on the 6 pose parameters, with the rotation updated
+// as R = exp(w) * R. Returns the number of iterations, or -1 if it failed.
+int HeadPoseTracker::refine(const std::vector<cv::Point2f> &points, cv::Matx33d &R,
+                            cv::Vec3d &t, double &error) const
+{
+    const double fx = K(0, 0), fy = K(1, 1), cx = K(0, 2), cy = K(1, 2);
+    double current = cost(points, R, t);
+    if (std::isinf(current)) {
+        return -1;
+    }
+    double lambda = 1e-3;
+    int it = 0;
+    for (; it < max_iterations; it++) {
+        cv::Matx66d JtJ = cv::Matx66d::zeros();
+        cv::Matx61d Jtr = cv::Matx61d::zeros();
+        for (size_t i = 0; i < model.size(); i++) {
+            const cv::Vec3d P = R * model[i];
+            const cv::Vec3d X = P + t;
+            const double iz = 1.0 / X[2];
+            const double ru = fx * X[0] * iz + cx - points[i].x;
+            const double rv = fy * X[1] * iz + cy - points[i].y;
+            // projection derivatives times dX/d(w, t) = [-[P]x | I]
+            const double ux = fx * iz, uz = -fx * X[0] * iz * iz;
+            const double vy = fy * iz, vz = -fy * X[1] * iz * iz;
+            const cv::Matx61d Ju(uz * P[1], ux * P[2] - uz * P[0], -ux * P[1],
+                                 ux, 0, uz);
+            const cv::Matx61d Jv(-vy * P[2] + vz * P[1], -vz * P[0], vy * P[0],
+                                 0, vy, vz);
+            JtJ += Ju * Ju.t() + Jv * Jv.t();
+            Jtr += Ju * ru + Jv * rv;
+        }
+
+        // retry with more damping until the step reduces the error
+        bool improved = false;
+        cv::Matx61d delta;
+        while (lambda < 1e6) {
+            cv::Matx66d A = JtJ;
+            for (int k = 0; k < 6; k++) {
+                A(k, k) += lambda * (JtJ(k, k) + 1e-9);
+            }
+            delta = A.solve(-Jtr, cv::DECOMP_CHOLESKY);
+            cv::Matx33d dR;
+            cv::Rodrigues(cv::Vec3d(delta(0), delta(1), delta(2)), dR);
+            const cv::Matx33d R_new = dR * R;
+            const cv::Vec3d t_new = t + cv::Vec3d(delta(3), delta(4), delta(5));
+            const double c = cost(points, R_new, t_new);
+            if (c < current) {
+                R = R_new;
+                t = t_new;
+                improved = (current - c) > 1e-10 * current;
+                current = c;
+                lambda = std::max(lambda * 0.1, 1e-7);
+                break;
+            }
+            lambda *= 10;
+        }
+        if (not improved) {
+            break;
+        }
+    }
+    error = std::sqrt(current / model.size());
+    return it;
+}
+
+void HeadPoseTracker::solve(const std::vector<cv::Point2f> &points, const HeadPose *previous,
+                            HeadPose &pose) const
+{
+    const int64 t0 = cv::getTickCount();
+    pose.center = cv::Point2f(0, 0);
+    for (const cv::Point2f &p : points) {
+        pose.center += p;
+    }
+    pose.center *= 1.0f / points.size();
+
+    pose.tracked = previous != NULL;
+    if (previous) {
+        // constant velocity prediction
+        cv::Matx33d dR;
+        cv::Rodrigues(previous->angular_velocity, dR);
+        pose.R = dR * previous->R;
+        pose.t = previous->t + previous->velocity;
+    } else {
+        // frontal: the model's y up and z towards the camera are flipped in
+        // camera coordinates; the depth comes from the ratio of the model's
+        // and the image points' spread
+        pose.R = cv::Matx33d(1, 0, 0, 0, -1, 0, 0, 0, -1);
+        double model_spread = 0, image_spread = 0;
+        cv::Vec3d model_center(0, 0, 0);
+        for (const cv::Vec3d &m : model) {
+            model_center += m * (1.0 / model.size());
+        }
+        for (size_t i = 0; i < model.size(); i++) {
+            const cv::Vec3d d = model[i] - model_center;
+            model_spread += d[0] * d[0] + d[1] * d[1];
+            const cv::Point2f e = points[i] - pose.center;
+            image_spread += e.x * e.x + e.y * e.y;
+        }
+        const double z = K(0, 0) * std::sqrt(model_spread / std::max(image_spread, 1e-6));
+        pose.t = cv::Vec3d((pose.center.x - K(0, 2)) * z / K(0, 0),
+                           (pose.center.y - K(1, 2)) * z / K(1, 1), z)
+                 - pose.R * model_center;
+    }
+
+    pose.iterations = refine(points, pose.R, pose.t, pose.error);
+    if (pose.iterations < 0 or pose.error > max_error) {
+        // the model has too few non-coplanar points for the DLT start of
+        // SOLVEPNP_ITERATIVE, so start from EPnP and refine that
+        cv::Mat rvec, tvec;
+        cv::solvePnP(object_points, points, K, cv::noArray(), rvec, tvec,
+                     false, cv::SOLVEPNP_EPNP);
+        cv::solvePnP(object_points, points, K, cv::noArray(), rvec, tvec,
+                     true, cv::SOLVEPNP_ITERATIVE);
+        cv::Rodrigues(rvec, pose.R);
+        pose.t = cv::Vec3d(tvec);
+        pose.error = std::sqrt(cost(points, pose.R, pose.t) / model.size());
+        pose.tracked = false;
+    }
+
+    if (pose.tracked) {
+        cv::Rodrigues(pose.R * previous->R.t(), pose.angular_velocity);
+        pose.velocity = pose.t - previous->t;
+    } else {
+        pose.angular_velocity = cv::Vec3d(0, 0, 0);
+        pose.velocity = cv::Vec3d(0, 0, 0);
+    }
+    cv::Rodrigues(pose.R, pose.rvec);
+    pose.ms = (cv::getTickCount() - t0) * 1000.0 / cv::getTickFrequency();
+}
+
+const std::vector<HeadPose> &HeadPoseTracker::update(
+    const std::vector<std::vector<cv::Point2f> > &image_points)
+{
+    std::vector<HeadPose> previous;
+    previous.swap(poses);
+    const int n = image_points.size();
+    poses.resize(n);
+
+    // warm start every face from the nearest unused face of the last frame
+    std::vector<const HeadPose *> starts(n, NULL);
+    std::vector<bool> used(previous.size(), false);
+    for (int i = 0; i < n; i++) {
+        cv::Point2f center(0, 0);
+        for (const cv::Point2f &p : image_points[i]) {
+            center += p;
+        }
+        center *= 1.0f / image_points[i].size();
+        double best = max_jump;
+        int best_j = -1;
+        for (size_t j = 0; j < previous.size(); j++) {
+            double d = cv::norm(previous[j].center - center);
+            if (not used[j] and d < best) {
+                best = d;
+                best_j = j;
+            }
+        }
+        if (best_j >= 0) {
+            used[best_j] = true;
+            starts[i] = &previous[best_j];
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, n), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            solve(image_points[i], starts[i], poses[i]);
+        }
+    });
+    return poses;
+}
@@ -0,0 +1,56 @@
+#ifndef HeadPose_hpp
+#define HeadPose_hpp
+
+#include <vector>
+
+#include "opencv2/core.hpp"
+
+struct HeadPose
+{
+    cv::Matx33d R;            // model to camera rotation
+    cv::Vec3d t;              // model to camera translation
+    cv::Vec3d rvec;           // R as a rotation vector, for cv::projectPoints
+    cv::Vec3d angular_velocity;   // rotation vector from the previous frame
+    cv::Vec3d velocity;           // translation from the previous frame
+    cv::Point2f center;       // centroid of the image points
+    double error;             // RMS reprojection error in pixels
+    int iterations;
+    double ms;                // time spent solving this face
+    bool tracked;             // warm started from a face of the previous frame
+};
+
+// Head pose of many faces per frame from a few landmarks each, eg. the eye
+// corners, nose tip and mouth corners. The pose is refined with Levenberg-
+// Marquardt on fixed size matrices, warm started from the nearest face of
+// the previous frame moved on at constant velocity. A new face starts
+// frontal, at the distance its landmark spread suggests. If the fit does
+// not converge it falls back to cv::solvePnP.
+class HeadPoseTracker
+{
+public:
+    // the model is expected with y up and z towards the viewer
+    HeadPoseTracker(const std::vector<cv::Point3f> &object_points,
+                    const cv::Matx33d &camera_matrix);
+    // image_points holds the points matching object_points, for every face
+    const std::vector<HeadPose> &update(const std::vector<std::vector<cv::Point2f> > &image_points);
+    void reset();
+
+    int max_iterations;
+    double max_error;   // RMS pixels above which the fit falls back
+    double max_jump;    // pixels a face may move and still be warm started
+
+private:
+    void solve(const std::vector<cv::Point2f> &points, const HeadPose *previous,
+               HeadPose &pose) const;
+    int refine(const std::vector<cv::Point2f> &points, cv::Matx33d &R, cv::Vec3d &t,
+               double &error) const;
+    double cost(const std::vector<cv::Point2f> &points, const cv::Matx33d &R,
+                const cv::Vec3d &t) const;
+
+    std::vector<cv::Point3f> object_points;
+    std::vector<cv::Vec3d> model;
+    cv::Matx33d K;
+    std::vector<HeadPose> poses;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#include "opencv2/imgproc.hpp"
+#include "landmark_tracker.hpp"
+
+void detectFace(const cv::Mat &image, std::vector<cv::Rect> &faces,
+                cv::CascadeClassifier &face_cascade, bool biggest_only)
+{
+    cv::Mat gray;
+    if (image.channels() > 1) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = image.clone();
+    }
+
+    cv::equalizeHist(gray, gray);
+
+    faces.clear();
+    int flags = cv::CASCADE_SCALE_IMAGE;
+    if (biggest_only) {
+        flags += cv::CASCADE_FIND_BIGGEST_OBJECT;
+    }
+    face_cascade.detectMultiScale(gray, faces, 1.4, 3, flags);
+}
+
+static float overlap(const cv::Rect &a, const cv::Rect &b)
+{
+    float inter = (a & b).area();
+    float uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0.0f;
+}
+
+LandmarkTracker::LandmarkTracker(const std::string &model_file,
+                                 cv::CascadeClassifier &face_cascade)
+    : model_file(model_file), face_cascade(face_cascade)
+{
+    detect_interval = 10;
+    max_faces = 4;
+    min_overlap = 0.5f;
+    reset();
+    loadFacemarks(1);
+}
+
+void LandmarkTracker::loadFacemarks(size_t count)
+{
+    while (facemarks.size() < count) {
+        cv::Ptr<cv::face::Facemark> facemark = cv::face::createFacemarkLBF();
+        facemark->loadModel(model_file);
+        facemarks.push_back(facemark);
+    }
+}
+
+void LandmarkTracker::reset()
+{
+    tracks.clear();
+    frames_since_detection = 0;
+    lost = true;
+    detected = false;
+}
+
+void LandmarkTracker::detect(const cv::Mat &img, std::vector<cv::Rect> &boxes)
+{
+    detectFace(img, boxes, face_cascade, max_faces == 1);
+    // keep the biggest faces
+    std::sort(boxes.begin(), boxes.end(), [](const cv::Rect &a, const cv::Rect &b) {
+        return a.area() > b.area();
+    });
+    if ((int)boxes.size() > max_faces) {
+        boxes.resize(max_faces);
+    }
+}
+
+const std::vector<FaceTrack> &LandmarkTracker::update(const cv::Mat &img)
+{
+    const cv::Rect frame(0, 0, img.cols, img.rows);
+    detected = lost or tracks.empty() or frames_since_detection >= detect_interval;
+    std::vector<cv::Rect> boxes;
+    if (detected) {
+        detect(img, boxes);
+        frames_since_detection = 0;
+    } else {
+        for (const FaceTrack &track : tracks) {
+            boxes.push_back(track.box);
+        }
+    }
+    frames_since_detection++;
+
+    // FacemarkLBF::fit keeps the face box in its parameters, so each face
+    // is fitted by its own Facemark; they are loaded the first time that
+    // many faces are tracked.
+    loadFacemarks(boxes.size());
+    std::vector<std::vector<cv::Point2f> > shapes(boxes.size());
+    std::vector<uchar> fitted(boxes.size(), 0);
+    cv::parallel_for_(cv::Range(0, (int)boxes.size()), [&](const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            std::vector<cv::Rect> face(1, boxes[i]);
+            std::vector<std::vector<cv::Point2f> > face_shapes;
+            if (facemarks[i]->fit(img, face, face_shapes) and not face_shapes.empty()) {
+                shapes[i].swap(face_shapes[0]);
+                fitted[i] = 1;
+            }
+        }
+    });
+
+    std::vector<FaceTrack> previous;
+    previous.swap(tracks);
+    lost = false;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        if (not fitted[i]) {
+            lost = true;
+            continue;
+        }
+        cv::Rect hull = cv::boundingRect(shapes[i]);
+        if (hull.width <= 0 or hull.height <= 0) {
+            lost = true;
+            continue;
+        }
+        FaceTrack track;
+        if (detected) {
+            // remember how the detector frames this face, to seed the next boxes
+            const cv::Rect &b = boxes[i];
+            track.hull_to_box = cv::Vec4f((b.x - hull.x) / (float)hull.width,
+                                          (b.y - hull.y) / (float)hull.height,
+                                          b.width / (float)hull.width,
+                                          b.height / (float)hull.height);
+        } else {
+            track.hull_to_box = previous[i].hull_to_box;
+        }
+        const cv::Vec4f &m = track.hull_to_box;
+        track.box = cv::Rect(cvRound(hull.x + m[0] * hull.width),
+                             cvRound(hull.y + m[1] * hull.height),
+                             cvRound(m[2] * hull.width),
+                             cvRound(m[3] * hull.height));
+        // a drifting fit no longer matches the box it was seeded with
+        if (not detected and overlap(track.box, boxes[i]) < min_overlap) {
+            lost = true;
+            continue;
+        }
+        if ((track.box & frame).area() < track.box.area() / 2) {
+            lost = true;
+            continue;
+        }
+        track.shape.swap(shapes[i]);
+        tracks.push_back(track);
+    }
+    return tracks;
+}
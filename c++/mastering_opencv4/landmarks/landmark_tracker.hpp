@@ -0,0 +1,56 @@
+#ifndef LandmarkTracker_hpp
+#define LandmarkTracker_hpp
+
+#include <string>
+#include <vector>
+
+#include "opencv2/core.hpp"
+#include "opencv2/face.hpp"
+#include "opencv2/objdetect.hpp"
+
+void detectFace(const cv::Mat &image, std::vector<cv::Rect> &faces,
+                cv::CascadeClassifier &face_cascade, bool biggest_only = true);
+
+struct FaceTrack
+{
+    cv::Rect box;                     // face box the landmarks were fitted in
+    std::vector<cv::Point2f> shape;   // landmarks of the last fit
+    // detector box relative to the landmark hull: x and y offset in hull
+    // widths / heights, then width and height in hull widths / heights
+    cv::Vec4f hull_to_box;
+};
+
+// Fits landmarks on every face of a video. The cascade detector only runs
+// every detect_interval frames or after a face was lost; in between each
+// face box is seeded from the hull of its previous landmarks. The faces of
+// a frame are fitted in parallel, each with its own copy of the LBF model.
+class LandmarkTracker
+{
+public:
+    LandmarkTracker(const std::string &model_file,
+                    cv::CascadeClassifier &face_cascade);
+    // returns the faces found in img, with their new landmarks
+    const std::vector<FaceTrack> &update(const cv::Mat &img);
+    void reset();
+
+    int detect_interval;
+    int max_faces;
+    // a fit whose landmark box overlaps its seed box less than this is
+    // treated as lost, and the detector runs again on the next frame
+    float min_overlap;
+    bool detected;  // whether the detector ran for the last frame
+
+private:
+    void detect(const cv::Mat &img, std::vector<cv::Rect> &boxes);
+    void loadFacemarks(size_t count);
+
+    std::string model_file;
+    // one per face slot, Facemark::fit is not safe to call concurrently
+    std::vector<cv::Ptr<cv::face::Facemark> > facemarks;
+    cv::CascadeClassifier &face_cascade;
+    std::vector<FaceTrack> tracks;
+    int frames_since_detection;
+    bool lost;
+};
+
+#endif
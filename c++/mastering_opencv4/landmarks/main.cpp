@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <istream>
@@ -13,54 +14,14 @@
 #include "opencv2/imgproc.hpp"
 #include "opencv2/calib3d.hpp"
 
-using $ = boost::format;
+#include "annotation.hpp"
+#include "annotation_cache.hpp"
+#include "evaluation.hpp"
+#include "head_pose.hpp"
+#include "landmark_tracker.hpp"
 
+using $ = boost::format;
 
-void detectFace(const cv::Mat &image, std::vector<cv::Rect> &faces, 
-                cv::CascadeClassifier &face_cascade)
-{
-    cv::Mat gray;
-    if (image.channels() > 1) {
-        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
-    } else {
-        gray = image.clone();
-    }
-    
-    cv::equalizeHist(gray, gray);
-
-    faces.clear();
-    face_cascade.detectMultiScale(gray, faces, 1.4, 3, 
-                                  cv::CASCADE_SCALE_IMAGE + 
-                                  cv::CASCADE_FIND_BIGGEST_OBJECT);
-}
-
-std::vector<cv::Point2f> readAnnotationFile(const std::string &file) 
-{
-    std::ifstream in(file);
-    std::string line;
-    for (int i = 0; i < 3; i++) {
-        std::getline(in, line);
-    }
-    std::vector<cv::Point2f> points;
-    while (std::getline(in, line)) {
-        std::stringstream l(line);
-        cv::Point2f p;
-        l >> p.x >> p.y;
-        if (p.x != 0.0 and p.y != 0.0) {
-            points.push_back(p);
-        }
-    }
-}
-
-float calMeanEuclideanDistance(const std::vector<cv::Point2f> &A, 
-                                     const std::vector<cv::Point2f> &B)
-{
-    float med = 0.0f;
-    for (int i = 0; i < A.size(); i++) {
-        med += cv::norm(A[i] - B[i]);
-    }
-    return med / (float)A.size();
-}
 
 std::vector<cv::Point3f> object_points {
     {8.27412, 1.33849, 10.63490},    // left eye corner
@@ -90,6 +51,14 @@ int main(int argc, char **argv) {
                                  landmark annotations}"
         "{ face_cascade c  |   | path to the face cascade xml file which you \
                                  want to use as a detector}"
+        "{ detect_interval d | 10 | run the face detector every N frames, \
+                                 faces are tracked from their landmarks in between}"
+        "{ max_faces m     | 4 | maximum number of faces to fit}"
+        "{ evaluate e      |   | measure landmark accuracy and speed over \
+                                 the video(s) in vid_base instead of showing them}"
+        "{ report r        |   | per frame evaluation results (csv)}"
+        "{ pack_annotations p |  | pack the annotations of the video(s) in \
+                                 vid_base into annot.bin files and exit}"
     );
 
     if (parser.has("help")) {
@@ -97,6 +66,19 @@ int main(int argc, char **argv) {
         std::cerr << "Tip: use absolute paths to avoid any problems" << std::endl;
         return 0;
     }
+    if (parser.has("pack_annotations")) {
+        std::vector<cv::String> videos;
+        cv::glob(parser.get<std::string>("vid_base") + "/vid.avi", videos, true);
+        for (const cv::String &video : videos) {
+            const std::string dir = video.substr(0, video.size() - std::string("/vid.avi").size());
+            if (not AnnotationCache::build(dir, AnnotationCache::defaultPath(dir))) {
+                std::cerr << "Failed to pack the annotations of " << dir << std::endl;
+                return -1;
+            }
+            std::cout << "Packed " << AnnotationCache::defaultPath(dir) << std::endl;
+        }
+        return 0;
+    }
     std::string filename(parser.get<std::string>("model_filename"));
     if (filename.empty()) {
         parser.printMessage();
@@ -116,6 +98,17 @@ int main(int argc, char **argv) {
         return -1;
     }
     
+    if (parser.has("evaluate")) {
+        return evaluateLandmarks(vid_base, filename, cascade_name,
+                                 parser.get<std::string>("report"));
+    }
+
+    // ground truth from the packed annotations if there are some, else the .pts files
+    AnnotationCache annotations;
+    const std::string cache_path = AnnotationCache::defaultPath(vid_base);
+    const bool has_cache = not AnnotationCache::isStale(vid_base, cache_path) and
+                           annotations.open(cache_path);
+
     cv::Mat org_img;
     cv::VideoCapture cap(vid_base + "/vid.avi");
     if (not cap.isOpened()) {
@@ -134,9 +127,10 @@ int main(int argc, char **argv) {
         std::cerr << "Failed to load cascade classifier: " << cascade_name << std::endl;
     }
 
-    cv::Ptr<cv::face::Facemark> facemark  = cv::face::createFacemarkLBF();
-    facemark->loadModel(filename);
+    LandmarkTracker tracker(filename, face_cascade);
     std::cout << "Loaded facemark LBF model" << std::endl;
+    tracker.detect_interval = std::max(1, parser.get<int>("detect_interval"));
+    tracker.max_faces = std::max(1, parser.get<int>("max_faces"));
 
     cv::Size small_size(700, 700*(float) org_img.rows / (float) org_img.cols);
     const float scale_factor = 700.0f / org_img.cols;
@@ -146,11 +140,8 @@ int main(int argc, char **argv) {
                    0, w, h/2.0f,
                    0, 0, 1.0f};
     cv::Mat img, img_out, img_out_dir;
-    // output rotation matrix and translation matrix
-    cv::Mat rvec = cv::Mat::zeros(3, 1, CV_64FC1);
-    cv::Mat tvec = cv::Mat::zeros(3, 1, CV_64FC1);
-    cv::Mat R = cv::Mat::eye(3, 3, CV_64FC1);
-    cv::Rodrigues(R, rvec);
+    // the landmarks are found in the resized image, so the pose is solved there too
+    HeadPoseTracker head_pose(object_points, camera_matrix);
     
     for (;;) {
         cap >> org_img;
@@ -159,8 +150,13 @@ int main(int argc, char **argv) {
         }
     
         const uint32_t frame_ID = cap.get(cv::CAP_PROP_POS_FRAMES);
-        const std::string filename = str($(vid_base + "/annot/%06d.pts") % frame_ID);
-        const std::vector<cv::Point2f> ground_truth = readAnnotationFile(filename);
+        std::vector<cv::Point2f> ground_truth;
+        int count = 0;
+        if (const cv::Point2f *points = annotations.points(frame_ID, count)) {
+            ground_truth.assign(points, points + count);
+        } else if (not has_cache) {
+            ground_truth = readAnnotationFile(annotationFileName(vid_base, frame_ID));
+        }
         cv::Mat(ground_truth) *= scale_factor;
         cv::resize(org_img, img, small_size, 0, 0, cv::INTER_LINEAR_EXACT);
         img.copyTo(img_out);
@@ -168,47 +164,67 @@ int main(int argc, char **argv) {
 
         cv::face::drawFacemarks(img_out, ground_truth, cv::Scalar(0, 255));
         
-        std::vector<cv::Rect> faces;
-        detectFace(img, faces, face_cascade);
+        const int64 t_fit = cv::getTickCount();
+        const std::vector<FaceTrack> &faces = tracker.update(img);
+        const double fit_ms = (cv::getTickCount() - t_fit) * 1000.0 / cv::getTickFrequency();
+        cv::putText(img_out,
+            str($("landmarks: %.1f ms, %d faces%s") % fit_ms % faces.size() %
+                (tracker.detected ? " (detected)" : "")),
+            {10, 60},
+            cv::FONT_HERSHEY_COMPLEX,
+            0.5,
+            cv::Scalar(0, 255, 0), 1);
+
+        for (const FaceTrack &face : faces) {
+            cv::rectangle(img_out, face.box, cv::Scalar(255, 0, 0), 2);
+            cv::face::drawFacemarks(img_out, face.shape, cv::Scalar(0, 0, 255));
+        }
 
-        if (faces.size() != 0) {
-            cv::rectangle(img_out, faces[0], cv::Scalar(255, 0, 0), 2);
-            std::vector<std::vector<cv::Point2f> > shapes;
-            
-            if (facemark->fit(img, faces, shapes)) {
-                cv::face::drawFacemarks(img_out, shapes[0], cv::Scalar(0, 0, 255));
-                cv::putText(img_out, 
-                    str($("MED: %.3f") % calMeanEuclideanDistance(shapes[0], ground_truth)),
-                    {10, 30},
-                    cv::FONT_HERSHEY_COMPLEX,
-                    0.75, 
-                    cv::Scalar(0, 255, 0), 2);
-                std::vector<cv::Point2f> points2d;
-                for (int pID : landmarks_IDs_for_3Dpoints) { 
-                    points2d.push_back(shapes[0][pID]/scale_factor);
-                }
-        
-                // solve object/camera transform
-                cv::solvePnP(object_points, points2d, camera_matrix, 
-                    cv::Mat(), // empty matrix means no distortion
-                    rvec, tvec, true);
-
-                // ?
-                std::vector<cv::Point2f> projection_output(
-                                            object_points_for_projection.size());
-                cv::projectPoints(object_points_for_projection, rvec, tvec, camera_matrix,
-                       cv::Mat(), projection_output); 
-                cv::Mat(projection_output) *= scale_factor;
-        
-                cv::arrowedLine(img_out, projection_output[0], projection_output[1], 
-                        cv::Scalar(255, 255, 0), 2, 8, 0, 0.3);
-                cv::arrowedLine(img_out, projection_output[0], projection_output[2], 
-                        cv::Scalar(0, 255, 255), 2, 8, 0, 0.3);
-                cv::arrowedLine(img_out, projection_output[0], projection_output[3], 
-                        cv::Scalar(255, 0, 255), 2, 8, 0, 0.3);
-            }
-        } else {
+        // the annotations are for the main (biggest) face; frames without
+        // ground truth for every landmark get no MED
+        if (faces.empty()) {
             std::cout << "Faces not detected." << std::endl;
+        } else if (ground_truth.size() == faces[0].shape.size()) {
+            cv::putText(img_out, 
+                str($("MED: %.3f") % calMeanEuclideanDistance(faces[0].shape, ground_truth)),
+                {10, 30},
+                cv::FONT_HERSHEY_COMPLEX,
+                0.75, 
+                cv::Scalar(0, 255, 0), 2);
+        }
+
+        // solve object/camera transform of all faces in one batch
+        std::vector<std::vector<cv::Point2f> > points2d(faces.size());
+        for (size_t i = 0; i < faces.size(); i++) {
+            for (int pID : landmarks_IDs_for_3Dpoints) { 
+                points2d[i].push_back(faces[i].shape[pID]);
+            }
+        }
+        const std::vector<HeadPose> &poses = head_pose.update(points2d);
+        double pose_ms = 0;
+        for (const HeadPose &pose : poses) {
+            // axes from the nose tip
+            std::vector<cv::Point2f> projection_output(
+                                        object_points_for_projection.size());
+            cv::projectPoints(object_points_for_projection, pose.rvec, pose.t, camera_matrix,
+                   cv::Mat(), projection_output); 
+    
+            cv::arrowedLine(img_out, projection_output[0], projection_output[1], 
+                    cv::Scalar(255, 255, 0), 2, 8, 0, 0.3);
+            cv::arrowedLine(img_out, projection_output[0], projection_output[2], 
+                    cv::Scalar(0, 255, 255), 2, 8, 0, 0.3);
+            cv::arrowedLine(img_out, projection_output[0], projection_output[3], 
+                    cv::Scalar(255, 0, 255), 2, 8, 0, 0.3);
+            pose_ms = std::max(pose_ms, pose.ms);
+        }
+        if (not poses.empty()) {
+            cv::putText(img_out,
+                str($("pose: %.3f ms/face max, %d iterations, %.2f px") % pose_ms %
+                    poses[0].iterations % poses[0].error),
+                {10, 80},
+                cv::FONT_HERSHEY_COMPLEX,
+                0.5,
+                cv::Scalar(0, 255, 0), 1);
         }
 
         // if (frame_ID % 10 = 0) 